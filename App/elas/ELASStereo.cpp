@@ -3,7 +3,7 @@
 
 ELASStereo::ELASStereo(calibu::CameraRig& rig, const unsigned int width,
                        const unsigned int height)
-  : m_dDisparity(width, height), m_dDepth(width, height) {
+  : m_dDisparity(width, height), m_dDepth(width, height), m_pelas(NULL) {
   if (rig.cameras.size() != 2) {
     std::cerr << "Two camera models are required to run this program!"
               << std::endl;
@@ -51,6 +51,11 @@ bool ELASStereo::InitELAS() {
   // ELAS image format
   m_I1 = new ELAS::image<uchar>(m_width, m_height);
   m_I2 = new ELAS::image<uchar>(m_width, m_height);
+
+  // ELAS instance, keeps its workspace between frames
+  Elas::parameters param;
+  param.postprocess_only_left = false;
+  m_pelas = new Elas(param);
 }
 
 void ELASStereo::Run(std::string sLeftName, std::string sRightName) {
@@ -68,11 +73,8 @@ void ELASStereo::Run(std::string sLeftName, std::string sRightName) {
   const int32_t dims[3] = {width, height, width};  // bytes per line = width
 
   // process
-  Elas::parameters param;
-  param.postprocess_only_left = false;
-  Elas elas(param);
-  elas.process(m_I1->data, m_I2->data, (float*)m_hDisparity1.data,
-               (float*)m_hDisparity2.data, dims);
+  m_pelas->process(m_I1->data, m_I2->data, (float*)m_hDisparity1.data,
+                   (float*)m_hDisparity2.data, dims);
 
   // -----
   // upload disparity to GPU
@@ -95,11 +97,8 @@ void ELASStereo::Run() {
   const int32_t dims[3] = {width, height, width};  // bytes per line = width
 
   // process
-  Elas::parameters param;
-  param.postprocess_only_left = false;
-  Elas elas(param);
-  elas.process(m_I1->data, m_I2->data, (float*)m_hDisparity1.data,
-               (float*)m_hDisparity2.data, dims);
+  m_pelas->process(m_I1->data, m_I2->data, (float*)m_hDisparity1.data,
+                   (float*)m_hDisparity2.data, dims);
 
   // -----
   // upload disparity to GPU
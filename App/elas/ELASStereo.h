@@ -151,6 +151,7 @@ class ELASStereo {
   ~ELASStereo() {
     delete m_I1;
     delete m_I2;
+    delete m_pelas;
   }
 
   bool InitELAS();
@@ -101,6 +101,7 @@ class ELASStereo {
   ~ELASStereo() {
     delete m_I1;
     delete m_I2;
+    delete m_pelas;
   }
 
   bool InitELAS();
@@ -0,0 +1,364 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+// Benchmark: runs process() on the stereo pairs in img/ and prints one JSON
+// object per line and configuration (pair, setting, subsampling, threads)
+// with stage latency percentiles, throughput and peak memory usage. Each
+// configuration runs in a child process of its own, hence its peak memory
+// usage does not include the runs before it.
+// Optionally the results are compared against reference disparity maps
+// (<pair>_left_disp.pgm, <pair>_right_disp.pgm) and the program fails if the
+// bad pixel rate exceeds a tolerance. The maps in img/ are the output of the
+// original library, hence this detects deviations from it rather than
+// measuring accuracy (the tests in CMakeLists.txt run it on aloe).
+// Try "./libelas_bench -h" for help.
+
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "elas.h"
+#include "image.h"
+
+using namespace std;
+
+#ifndef LIBELAS_IMG_DIR
+#define LIBELAS_IMG_DIR "img"
+#endif
+
+// stereo pairs shipped in img/
+static const char* pair_names[] = {"aloe","cones","raindeer","urban1","urban2","urban3","urban4"};
+static const int32_t num_pairs  = sizeof(pair_names)/sizeof(pair_names[0]);
+
+// stages of Elas::stats, in this order
+static const char* stage_names[] = {"descriptor","support_matches","triangulation","grid","matching",
+                                    "lr_check","remove_small_segments","gap_interpolation","filtering","total"};
+static const int32_t num_stages  = 10;
+
+static double getStage (const Elas::stats &s,int32_t i) {
+  const double vals[] = {s.descriptor,s.support_matches,s.triangulation,s.grid,s.matching,
+                         s.lr_check,s.remove_small_segments,s.gap_interpolation,s.filtering,s.total};
+  return vals[i];
+}
+
+// p-th percentile (nearest rank) of sorted values
+static double percentile (const vector<double> &sorted,double p) {
+  int32_t idx = (int32_t)(p/100.0*sorted.size()+0.5)-1;
+  idx = max(0,min((int32_t)sorted.size()-1,idx));
+  return sorted[idx];
+}
+
+// peak resident set size of this process in kilobytes (a child process
+// starts with the pages it shares with its parent)
+static long getPeakRSS () {
+  rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss/1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// bad pixel rate and density of a disparity map (in percent)
+struct accuracy {
+  double bad;     // reference pixels which are invalid or off by more than the threshold
+  double density; // valid pixels
+};
+
+// compares D (D_width x D_height, every step-th pixel of the reference) with an
+// 8 bit reference map as written by the libelas demo: disparities scaled to
+// [0,255] by an unknown factor, 0 = invalid. the factor is estimated as the
+// median ratio of both maps, and half a quantization step is tolerated.
+static accuracy evaluate (const float* D,int32_t D_width,int32_t D_height,int32_t step,
+                          ELAS::image<ELAS::uchar>* ref,float threshold) {
+
+  // estimate scale of the reference map
+  vector<float> ratio;
+  for (int32_t v=0; v<D_height; v++)
+    for (int32_t u=0; u<D_width; u++) {
+      float   d = D[v*D_width+u];
+      int32_t r = imRef(ref,u*step,v*step);
+      if (d>0 && r>0)
+        ratio.push_back((r+0.5f)/d);
+    }
+  float scale = 1;
+  if (!ratio.empty()) {
+    nth_element(ratio.begin(),ratio.begin()+ratio.size()/2,ratio.end());
+    scale = ratio[ratio.size()/2];
+  }
+
+  // count bad and valid pixels
+  int32_t num_ref = 0,num_bad = 0,num_valid = 0;
+  for (int32_t v=0; v<D_height; v++)
+    for (int32_t u=0; u<D_width; u++) {
+      float   d = D[v*D_width+u];
+      int32_t r = imRef(ref,u*step,v*step);
+      if (d>=0)
+        num_valid++;
+      if (r>0) {
+        num_ref++;
+        if (d<0 || fabs(d-(r+0.5f)/scale)>threshold+0.5f/scale)
+          num_bad++;
+      }
+    }
+
+  accuracy acc;
+  acc.bad     = num_ref>0 ? 100.0*num_bad/num_ref : 0;
+  acc.density = 100.0*num_valid/(D_width*D_height);
+  return acc;
+}
+
+// loads a reference map if it exists
+static ELAS::image<ELAS::uchar>* loadReference (const string &file) {
+  FILE* f = fopen(file.c_str(),"rb");
+  if (f==0)
+    return 0;
+  fclose(f);
+  return ELAS::loadPGM(file.c_str());
+}
+
+// parses a comma separated list of integers
+static vector<int32_t> parseList (const char* str) {
+  vector<int32_t> list;
+  for (const char* c=str; *c; ) {
+    list.push_back(atoi(c));
+    while (*c && *c!=',') c++;
+    if (*c==',') c++;
+  }
+  return list;
+}
+
+static void help () {
+  cerr << "usage: libelas_bench [options]" << endl
+       << "  -i <dir>     directory with the stereo pairs (default: " << LIBELAS_IMG_DIR << ")" << endl
+       << "  -p <name>    only run this pair, may be given several times (default: all)" << endl
+       << "  -w <n>       warmup runs per configuration (default: 2)" << endl
+       << "  -n <n>       measured runs per configuration (default: 10)" << endl
+       << "  -t <list>    comma separated thread counts, 0 = OpenMP default (default: 0)" << endl
+       << "  -s <list>    comma separated subsampling flags (default: 0)" << endl
+       << "  -c <name>    only run this setting: robotics or middlebury (default: both)" << endl
+       << "  -l <0|1>     overrides parameters::postprocess_only_left" << endl
+       << "  -f <0|1>     overrides parameters::fast_triangulation (0 = Triangle)" << endl
+       << "  -v <0|1>     overrides parameters::temporal_support (each run is a frame of a static video," << endl
+       << "               matched with the disparity maps of the previous run)" << endl
+       << "  -g <px>      compare with the reference maps <pair>_left_disp.pgm and" << endl
+       << "               <pair>_right_disp.pgm, bad pixel threshold in pixels" << endl
+       << "  -a <pct>     fail (exit code 2) if a bad pixel rate exceeds pct percent" << endl;
+}
+
+int main (int argc,char** argv) {
+
+  // options
+  string img_dir = LIBELAS_IMG_DIR;
+  vector<string> pairs;
+  int32_t num_warmup = 2;
+  int32_t num_runs   = 10;
+  vector<int32_t> threads(1,0);
+  vector<int32_t> subsampling(1,0);
+  int32_t setting_first = 0,setting_last = 1;
+  int32_t only_left     = -1;
+  int32_t fast_tri      = -1;
+  int32_t temporal      = -1;
+  float   bad_threshold = -1;
+  float   bad_max       = -1;
+  for (int32_t i=1; i<argc; i++) {
+    string arg = argv[i];
+    if (arg=="-h" || i+1>=argc) { help(); return arg=="-h" ? 0 : 1; }
+    if      (arg=="-i") img_dir     = argv[++i];
+    else if (arg=="-p") pairs.push_back(argv[++i]);
+    else if (arg=="-w") num_warmup  = atoi(argv[++i]);
+    else if (arg=="-n") num_runs    = max(1,atoi(argv[++i]));
+    else if (arg=="-t") threads     = parseList(argv[++i]);
+    else if (arg=="-s") subsampling = parseList(argv[++i]);
+    else if (arg=="-l") only_left   = atoi(argv[++i]);
+    else if (arg=="-f") fast_tri    = atoi(argv[++i]);
+    else if (arg=="-v") temporal    = atoi(argv[++i]);
+    else if (arg=="-g") bad_threshold = atof(argv[++i]);
+    else if (arg=="-a") bad_max     = atof(argv[++i]);
+    else if (arg=="-c") {
+      string setting = argv[++i];
+      if      (setting=="robotics")   setting_first = setting_last = 0;
+      else if (setting=="middlebury") setting_first = setting_last = 1;
+      else { help(); return 1; }
+    }
+    else { help(); return 1; }
+  }
+  if (pairs.empty())
+    pairs.assign(pair_names,pair_names+num_pairs);
+  bool accuracy_ok = true;
+
+  for (int32_t p=0; p<(int32_t)pairs.size(); p++) {
+
+    // load images
+    ELAS::image<ELAS::uchar> *I1,*I2;
+    try {
+      I1 = ELAS::loadPGM((img_dir+"/"+pairs[p]+"_left.pgm").c_str());
+      I2 = ELAS::loadPGM((img_dir+"/"+pairs[p]+"_right.pgm").c_str());
+    } catch (ELAS::pnm_error) {
+      return 1;
+    }
+    int32_t width  = I1->width();
+    int32_t height = I1->height();
+    if (I2->width()!=width || I2->height()!=height) {
+      cerr << "ERROR: Images of pair " << pairs[p] << " must be of same size" << endl;
+      return 1;
+    }
+    const int32_t dims[3] = {width,height,width};
+
+    // reference maps (optional)
+    ELAS::image<ELAS::uchar> *R1 = 0,*R2 = 0;
+    if (bad_threshold>=0) {
+      R1 = loadReference(img_dir+"/"+pairs[p]+"_left_disp.pgm");
+      R2 = loadReference(img_dir+"/"+pairs[p]+"_right_disp.pgm");
+      if ((R1 && (R1->width()!=width || R1->height()!=height)) ||
+          (R2 && (R2->width()!=width || R2->height()!=height))) {
+        cerr << "ERROR: Reference maps of pair " << pairs[p] << " must be of image size" << endl;
+        return 1;
+      }
+    }
+
+    // output memory (large enough for both subsampling modes)
+    float* D1 = (float*)malloc(width*height*sizeof(float));
+    float* D2 = (float*)malloc(width*height*sizeof(float));
+
+    for (int32_t setting=setting_first; setting<=setting_last; setting++) {
+      for (int32_t s=0; s<(int32_t)subsampling.size(); s++) {
+        for (int32_t t=0; t<(int32_t)threads.size(); t++) {
+
+          // run the configuration in a child process, the parent collects
+          // its exit code (0: ok, 2: accuracy failed, otherwise an error)
+          fflush(stdout);
+          pid_t pid = fork();
+          if (pid<0) {
+            cerr << "ERROR: Could not start a process for the next configuration" << endl;
+            return 1;
+          }
+          if (pid>0) {
+            int status = 0;
+            if (waitpid(pid,&status,0)!=pid || !WIFEXITED(status) ||
+                (WEXITSTATUS(status)!=0 && WEXITSTATUS(status)!=2)) {
+              cerr << "ERROR: Configuration of pair " << pairs[p] << " failed" << endl;
+              return 1;
+            }
+            accuracy_ok = accuracy_ok && WEXITSTATUS(status)==0;
+            continue;
+          }
+          accuracy_ok = true;
+
+          Elas::parameters param(setting==0 ? Elas::ROBOTICS : Elas::MIDDLEBURY);
+          param.subsampling = subsampling[s]!=0;
+          param.num_threads = threads[t];
+          if (only_left>=0)
+            param.postprocess_only_left = only_left!=0;
+          if (fast_tri>=0)
+            param.fast_triangulation = fast_tri!=0;
+          if (temporal>=0)
+            param.temporal_support = temporal!=0;
+          Elas elas(param);
+
+          // video: each frame gets the disparity maps of the previous one
+          const float* D1_prev = 0;
+          const float* D2_prev = 0;
+
+          // warmup (also allocates the workspace)
+          for (int32_t i=0; i<num_warmup; i++) {
+            elas.process(I1->data,I2->data,D1,D2,dims,D1_prev,D2_prev);
+            if (param.temporal_support) {
+              D1_prev = D1;
+              D2_prev = D2;
+            }
+          }
+
+          // measure
+          vector< vector<double> > times(num_stages);
+          Elas::stats stats;
+          for (int32_t i=0; i<num_runs; i++) {
+            stats = elas.process(I1->data,I2->data,D1,D2,dims,D1_prev,D2_prev);
+            if (param.temporal_support) {
+              D1_prev = D1;
+              D2_prev = D2;
+            }
+            for (int32_t j=0; j<num_stages; j++)
+              times[j].push_back(getStage(stats,j));
+          }
+
+          // print results
+          printf("{\"pair\":\"%s\",\"setting\":\"%s\",\"subsampling\":%d,\"threads\":%d,"
+                 "\"fast_triangulation\":%d,\"width\":%d,\"height\":%d,\"runs\":%d,",
+                 pairs[p].c_str(),setting==0 ? "ROBOTICS" : "MIDDLEBURY",param.subsampling ? 1 : 0,
+                 threads[t],param.fast_triangulation ? 1 : 0,width,height,num_runs);
+          printf("\"stages_ms\":{");
+          for (int32_t j=0; j<num_stages; j++) {
+            sort(times[j].begin(),times[j].end());
+            printf("%s\"%s\":{\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                   j ? "," : "",stage_names[j],times[j].front(),percentile(times[j],50),
+                   percentile(times[j],90),percentile(times[j],99),times[j].back());
+          }
+          printf("},\"megapixels_per_s\":%.3f,", (double)width*height*1e-6/(percentile(times[num_stages-1],50)*1e-3));
+          printf("\"support_points\":%d,\"triangles\":%d,\"sad_evaluations\":%lld,",
+                 stats.num_support_points,stats.num_triangles,(long long)stats.num_sad_evaluations);
+          printf("\"support_reused\":%d,\"triangulations_reused\":%d,\"triangulations_updated\":%d,\"prior_matches\":%d,",
+                 stats.num_support_reused,stats.num_triangulations_reused,stats.num_triangulations_updated,
+                 stats.num_prior_matches);
+          printf("\"peak_rss_kb\":%ld",getPeakRSS());
+
+          // accuracy of the last run
+          int32_t step     = param.subsampling ? 2 : 1;
+          int32_t D_width  = width/step;
+          int32_t D_height = height/step;
+          ELAS::image<ELAS::uchar>* R[2] = {R1,R2};
+          float* D[2] = {D1,D2};
+          const char* side[2] = {"left","right"};
+          for (int32_t k=0; k<2; k++) {
+            if (R[k]==0)
+              continue;
+            accuracy acc = evaluate(D[k],D_width,D_height,step,R[k],bad_threshold);
+            bool ok = bad_max<0 || acc.bad<=bad_max;
+            accuracy_ok = accuracy_ok && ok;
+            printf(",\"accuracy_%s\":{\"threshold_px\":%.2f,\"bad_pct\":%.3f,\"density_pct\":%.3f,\"ok\":%s}",
+                   side[k],bad_threshold,acc.bad,acc.density,ok ? "true" : "false");
+          }
+          printf("}\n");
+          fflush(stdout);
+          _exit(accuracy_ok ? 0 : 2);
+        }
+      }
+    }
+
+    free(D1);
+    free(D2);
+    delete I1;
+    delete I2;
+    delete R1;
+    delete R2;
+  }
+
+  return accuracy_ok ? 0 : 2;
+}
@@ -0,0 +1,437 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "delaunay.h"
+
+using namespace std;
+
+int32_t Delaunay::makeEdge (int32_t a,int32_t b) {
+  int32_t e;
+  if (!free_quads.empty()) {
+    e = free_quads.back()*4;
+    free_quads.pop_back();
+  } else {
+    e = next.size();
+    next.resize(e+4);
+    org.resize(e+4);
+  }
+  next[e] = e; next[e+1] = e+3; next[e+2] = e+2; next[e+3] = e+1;
+  org[e]  = a; org[e+1]  = -1;  org[e+2]  = b;   org[e+3]  = -1;
+  return e;
+}
+
+void Delaunay::splice (int32_t a,int32_t b) {
+  int32_t alpha = rot(next[a]);
+  int32_t beta  = rot(next[b]);
+  swap(next[a],next[b]);
+  swap(next[alpha],next[beta]);
+}
+
+int32_t Delaunay::connect (int32_t a,int32_t b) {
+  int32_t e = makeEdge(dest(a),org[b]);
+  splice(e,lnext(a));
+  splice(sym(e),b);
+  return e;
+}
+
+void Delaunay::deleteEdge (int32_t e) {
+  splice(e,oprev(e));
+  splice(sym(e),oprev(sym(e)));
+  e &= ~3;
+  next[e] = -1;
+  free_quads.push_back(e/4);
+}
+
+void Delaunay::swapEdge (int32_t e) {
+  int32_t a = oprev(e);
+  int32_t b = oprev(sym(e));
+  splice(e,a);
+  splice(sym(e),b);
+  splice(e,lnext(a));
+  splice(sym(e),lnext(b));
+  org[e]      = dest(a);
+  org[sym(e)] = dest(b);
+}
+
+int64_t Delaunay::ccw (int32_t a,int32_t b,int32_t c) const {
+  return (int64_t)(x[b]-x[a])*(y[c]-y[a])-(int64_t)(y[b]-y[a])*(x[c]-x[a]);
+}
+
+bool Delaunay::inCircle (int32_t a,int32_t b,int32_t c,int32_t d) const {
+  int64_t adx = x[a]-x[d], ady = y[a]-y[d];
+  int64_t bdx = x[b]-x[d], bdy = y[b]-y[d];
+  int64_t cdx = x[c]-x[d], cdy = y[c]-y[d];
+  int64_t alift = adx*adx+ady*ady;
+  int64_t blift = bdx*bdx+bdy*bdy;
+  int64_t clift = cdx*cdx+cdy*cdy;
+  return alift*(bdx*cdy-cdx*bdy)+blift*(cdx*ady-adx*cdy)+clift*(adx*bdy-bdx*ady) > 0;
+}
+
+void Delaunay::build (int32_t lo,int32_t hi,int32_t &le,int32_t &re) {
+
+  // two or three vertices
+  if (hi-lo==2) {
+    int32_t a = makeEdge(lo,lo+1);
+    le = a; re = sym(a);
+    return;
+  }
+  if (hi-lo==3) {
+    int32_t a = makeEdge(lo,lo+1);
+    int32_t b = makeEdge(lo+1,lo+2);
+    splice(sym(a),b);
+    int64_t o = ccw(lo,lo+1,lo+2);
+    if (o>0) {
+      connect(b,a);
+      le = a; re = sym(b);
+    } else if (o<0) {
+      int32_t c = connect(b,a);
+      le = sym(c); re = c;
+    } else {
+      le = a; re = sym(b);
+    }
+    return;
+  }
+
+  // triangulate both halves
+  int32_t ldo,ldi,rdi,rdo;
+  int32_t mid = lo+(hi-lo)/2;
+  build(lo,mid,ldo,ldi);
+  build(mid,hi,rdi,rdo);
+
+  // lower common tangent of both hulls
+  while (true) {
+    if      (leftOf(org[rdi],ldi))  ldi = lnext(ldi);
+    else if (rightOf(org[ldi],rdi)) rdi = rprev(rdi);
+    else break;
+  }
+  int32_t basel = connect(sym(rdi),ldi);
+  if (org[ldi]==org[ldo]) ldo = sym(basel);
+  if (org[rdi]==org[rdo]) rdo = basel;
+
+  // merge upwards, deleting the edges which are no longer Delaunay
+  while (true) {
+    int32_t lcand = onext(sym(basel));
+    bool lvalid = rightOf(dest(lcand),basel);
+    if (lvalid) {
+      while (inCircle(dest(basel),org[basel],dest(lcand),dest(onext(lcand)))) {
+        int32_t t = onext(lcand);
+        deleteEdge(lcand);
+        lcand = t;
+      }
+    }
+    int32_t rcand = oprev(basel);
+    bool rvalid = rightOf(dest(rcand),basel);
+    if (rvalid) {
+      while (inCircle(dest(basel),org[basel],dest(rcand),dest(oprev(rcand)))) {
+        int32_t t = oprev(rcand);
+        deleteEdge(rcand);
+        rcand = t;
+      }
+    }
+    if (!lvalid && !rvalid)
+      break;
+    if (!lvalid || (rvalid && inCircle(dest(lcand),org[lcand],org[rcand],dest(rcand))))
+      basel = connect(rcand,sym(basel));
+    else
+      basel = connect(sym(basel),sym(lcand));
+  }
+  le = ldo; re = rdo;
+}
+
+bool Delaunay::sortPoints (const int32_t* points,int32_t n) {
+
+  // coordinate range (limited by the integer predicates)
+  int32_t u_min = points[0], u_max = points[0];
+  int32_t v_min = points[1], v_max = points[1];
+  for (int32_t i=1; i<n; i++) {
+    u_min = min(u_min,points[2*i]); u_max = max(u_max,points[2*i]);
+    v_min = min(v_min,points[2*i+1]); v_max = max(v_max,points[2*i+1]);
+  }
+  if (u_max-u_min>=max_range || v_max-v_min>=max_range)
+    return false;
+
+  // sort lexicographically by (u,v): counting sort by v, then stable by u
+  order.resize(n);
+  order_tmp.resize(n);
+  count.assign(v_max-v_min+2,0);
+  for (int32_t i=0; i<n; i++)
+    count[points[2*i+1]-v_min+1]++;
+  for (size_t k=1; k<count.size(); k++)
+    count[k] += count[k-1];
+  for (int32_t i=0; i<n; i++)
+    order_tmp[count[points[2*i+1]-v_min]++] = i;
+  count.assign(u_max-u_min+2,0);
+  for (int32_t i=0; i<n; i++)
+    count[points[2*i]-u_min+1]++;
+  for (size_t k=1; k<count.size(); k++)
+    count[k] += count[k-1];
+  for (int32_t k=0; k<n; k++) {
+    int32_t i = order_tmp[k];
+    order[count[points[2*i]-u_min]++] = i;
+  }
+  return true;
+}
+
+void Delaunay::findHull (int32_t le) {
+
+  // the outer face lies right of the counterclockwise hull edge le
+  on_hull.assign(x.size(),0);
+  hull_edges.clear();
+  int32_t e = sym(le);
+  do {
+    on_hull[org[e]] = 1;
+    hull_edges.push_back(e);
+    e = lnext(e);
+  } while (e!=sym(le));
+}
+
+void Delaunay::collectTriangles (vector<int32_t> &tri) {
+
+  // each bounded face from its edge with the smallest index
+  tri.clear();
+  for (int32_t q=0; q<(int32_t)next.size(); q+=4) {
+    if (next[q]<0)
+      continue;
+    for (int32_t e=q; e<=q+2; e+=2) {
+      int32_t e1 = lnext(e);
+      int32_t e2 = lnext(e1);
+      if (lnext(e2)!=e || e1<e || e2<e || ccw(org[e],org[e1],org[e2])<=0)
+        continue;
+      tri.push_back(id[org[e]]);
+      tri.push_back(id[org[e1]]);
+      tri.push_back(id[org[e2]]);
+    }
+  }
+}
+
+bool Delaunay::triangulate (const int32_t* points,int32_t n,vector<int32_t> &tri) {
+
+  tri.clear();
+  next.clear();
+  org.clear();
+  free_quads.clear();
+  x.clear(); y.clear(); id.clear();
+  free_vertices.clear();
+  valid = false;
+  if (n<=0)
+    return true;
+  if (!sortPoints(points,n))
+    return false;
+
+  // unique vertices (stable, hence the first of identical points is kept)
+  x.reserve(n); y.reserve(n); id.reserve(n);
+  for (int32_t k=0; k<n; k++) {
+    int32_t i = order[k];
+    if (!x.empty() && x.back()==points[2*i] && y.back()==points[2*i+1])
+      continue;
+    x.push_back(points[2*i]);
+    y.push_back(points[2*i+1]);
+    id.push_back(i);
+  }
+  int32_t num = x.size();
+  if (num<3)
+    return true;
+
+  // triangulate (a triangulation has less than 3*num edges)
+  next.reserve(12*num);
+  org.reserve(12*num);
+  int32_t le,re;
+  build(0,num,le,re);
+  tri.reserve(6*num);
+  collectTriangles(tri);
+
+  // keep the triangulation for update() unless all points are collinear
+  if (!tri.empty()) {
+    sorted.resize(num);
+    for (int32_t i=0; i<num; i++)
+      sorted[i] = i;
+    findHull(le);
+    valid = true;
+  }
+  return true;
+}
+
+int32_t Delaunay::locate (int32_t v) {
+
+  // walk from a hull edge towards vertex v (Guibas & Stolfi), returns an
+  // edge out of v if v is a vertex, otherwise an edge of the triangle
+  // containing v (on its left) or -1 if the walk does not end
+  int32_t e = hull_edges[0];
+  for (size_t k=0; k<next.size(); k++) {
+    if (org[e]==v)                 return e;
+    else if (dest(e)==v)           return sym(e);
+    else if (rightOf(v,e))         e = sym(e);
+    else if (!rightOf(v,onext(e))) e = onext(e);
+    else if (!rightOf(v,dprev(e))) e = dprev(e);
+    else                           return e;
+  }
+  return -1;
+}
+
+bool Delaunay::removeVertex (int32_t v) {
+
+  // delete the edges out of v, their left neighbors enclose the hole
+  int32_t e = locate(v);
+  if (e<0 || org[e]!=v)
+    return false;
+  star.clear();
+  hole.clear();
+  int32_t f = e;
+  do {
+    star.push_back(f);
+    hole.push_back(lnext(f));
+    f = onext(f);
+  } while (f!=e);
+  for (size_t k=0; k<star.size(); k++)
+    deleteEdge(star[k]);
+
+  // the hole is star shaped, hence it is triangulated by cutting off
+  // convex ears whose circumcircle contains no other vertex of the hole
+  int32_t k = hole.size();
+  while (k>3) {
+    bool found = false;
+    for (int32_t i=0; i<k && !found; i++) {
+      int32_t j = (i+1)%k;
+      int32_t a = hole[i], b = hole[j];
+      int32_t p0 = org[a], p1 = org[b], p2 = dest(b);
+      if (ccw(p0,p1,p2)<=0)
+        continue;
+      found = true;
+      for (int32_t l=(j+2)%k; l!=i && found; l=(l+1)%k)
+        found = !inCircle(p0,p1,p2,org[hole[l]]);
+      if (found) {
+        hole[i] = sym(connect(b,a));
+        hole.erase(hole.begin()+j);
+        k--;
+      }
+    }
+    if (!found)
+      return false;
+  }
+  return true;
+}
+
+bool Delaunay::insertVertex (int32_t v) {
+
+  // connect v to the corners of its triangle, or of both triangles of the
+  // edge it lies on (Guibas & Stolfi)
+  int32_t e = locate(v);
+  if (e<0 || org[e]==v)
+    return false;
+  if (ccw(v,org[e],dest(e))==0) {
+    e = oprev(e);
+    deleteEdge(onext(e));
+  }
+  int32_t base  = makeEdge(org[e],v);
+  int32_t first = base;
+  splice(base,e);
+  do {
+    base = connect(e,sym(base));
+    e    = oprev(base);
+  } while (lnext(e)!=first);
+
+  // flip the edges opposite to v until they are Delaunay
+  while (true) {
+    int32_t t = oprev(e);
+    if (rightOf(dest(t),e) && inCircle(org[e],dest(t),dest(e),v)) {
+      swapEdge(e);
+      e = oprev(e);
+    } else if (onext(e)==first) {
+      return true;
+    } else {
+      e = lprev(onext(e));
+    }
+  }
+}
+
+bool Delaunay::update (const int32_t* points,int32_t n,vector<int32_t> &tri,int32_t max_changes,bool &incremental) {
+
+  incremental = false;
+  if (!valid || n<3 || !sortPoints(points,n))
+    return triangulate(points,n,tri);
+
+  // compare the sorted points with the sorted vertices: common points keep
+  // their vertex, the others are removed or added (sorted_tmp refers to
+  // them by -1-index into added)
+  removed.clear();
+  added.clear();
+  sorted_tmp.clear();
+  size_t j = 0;
+  for (int32_t k=0; k<n; k++) {
+    int32_t i = order[k];
+    int32_t u = points[2*i], v = points[2*i+1];
+    if (k>0 && u==points[2*order[k-1]] && v==points[2*order[k-1]+1])
+      continue;
+    while (j<sorted.size() && (x[sorted[j]]<u || (x[sorted[j]]==u && y[sorted[j]]<v)))
+      removed.push_back(sorted[j++]);
+    if (j<sorted.size() && x[sorted[j]]==u && y[sorted[j]]==v) {
+      id[sorted[j]] = i;
+      sorted_tmp.push_back(sorted[j++]);
+    } else {
+      sorted_tmp.push_back(-1-(int32_t)added.size());
+      added.push_back(i);
+    }
+  }
+  while (j<sorted.size())
+    removed.push_back(sorted[j++]);
+  if ((int32_t)(removed.size()+added.size())>max_changes)
+    return triangulate(points,n,tri);
+
+  // the hull must stay the same: no hull vertex is removed and all new
+  // vertices lie strictly inside (they take unused or new vertex slots)
+  for (size_t k=0; k<removed.size(); k++)
+    if (on_hull[removed[k]])
+      return triangulate(points,n,tri);
+  for (size_t k=0; k<added.size(); k++) {
+    int32_t i = added[k];
+    int32_t v;
+    if (!free_vertices.empty()) {
+      v = free_vertices.back();
+      free_vertices.pop_back();
+    } else {
+      v = x.size();
+      x.push_back(0); y.push_back(0); id.push_back(0); on_hull.push_back(0);
+    }
+    x[v] = points[2*i]; y[v] = points[2*i+1]; id[v] = i;
+    for (size_t h=0; h<hull_edges.size(); h++)
+      if (!rightOf(v,hull_edges[h]))
+        return triangulate(points,n,tri);
+    added[k] = v;
+  }
+
+  // delete, then insert
+  for (size_t k=0; k<removed.size(); k++) {
+    if (!removeVertex(removed[k]))
+      return triangulate(points,n,tri);
+    free_vertices.push_back(removed[k]);
+  }
+  for (size_t k=0; k<added.size(); k++)
+    if (!insertVertex(added[k]))
+      return triangulate(points,n,tri);
+  for (size_t k=0; k<sorted_tmp.size(); k++)
+    if (sorted_tmp[k]<0)
+      sorted_tmp[k] = added[-1-sorted_tmp[k]];
+  sorted.swap(sorted_tmp);
+
+  collectTriangles(tri);
+  incremental = true;
+  return true;
+}
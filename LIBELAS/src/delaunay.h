@@ -0,0 +1,150 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+
+#ifndef __DELAUNAY_H__
+#define __DELAUNAY_H__
+
+#include <vector>
+
+// define fixed-width datatypes for Visual Studio projects
+#ifndef _MSC_VER
+  #include <stdint.h>
+#else
+  typedef __int8            int8_t;
+  typedef __int16           int16_t;
+  typedef __int32           int32_t;
+  typedef __int64           int64_t;
+  typedef unsigned __int8   uint8_t;
+  typedef unsigned __int16  uint16_t;
+  typedef unsigned __int32  uint32_t;
+  typedef unsigned __int64  uint64_t;
+#endif
+
+// Delaunay triangulation of points with integer coordinates, such as the
+// support points which lie on the regular candidate grid (plus the image
+// corners). the points are ordered by a linear time radix sort and
+// triangulated by divide and conquer (Guibas & Stolfi) with exact 64 bit
+// integer orientation and incircle tests, hence without the adaptive
+// floating point predicates of Triangle. the edge memory is kept between
+// calls, and so is the triangulation, which update() changes locally for the
+// next set of points. an instance must not be used by two threads at the same time.
+class Delaunay {
+
+public:
+
+  // coordinates of a call must span less than max_range in u and in v,
+  // this guarantees that the incircle determinant fits into 64 bit
+  static const int32_t max_range = 16384;
+
+  Delaunay () : valid(false) {}
+
+  // triangulates the n points (points[2*i],points[2*i+1]) and writes the
+  // point indices of each triangle (counterclockwise) to tri, 3 per triangle.
+  // of several identical points only the first one is used.
+  // returns false (with tri empty) if the coordinates exceed max_range,
+  // the caller has to fall back to a general triangulation then
+  bool triangulate (const int32_t* points,int32_t n,std::vector<int32_t> &tri);
+
+  // triangulates the n points like triangulate(), but starts from the
+  // triangulation of the last call: vertices which are no longer among the
+  // points are deleted and new points are inserted (points are identified
+  // by their coordinates). this is only done if at most max_changes vertices
+  // change and the convex hull stays the same, otherwise all points are
+  // triangulated again. incremental tells which of both happened.
+  // cocircular points may be split differently than by triangulate()
+  bool update (const int32_t* points,int32_t n,std::vector<int32_t> &tri,int32_t max_changes,bool &incremental);
+
+private:
+
+  // the triangulation owns its memory, hence no copies
+  Delaunay (const Delaunay&);
+  Delaunay& operator= (const Delaunay&);
+
+  // quad-edge structure: edge e belongs to quad e/4, e%4 is the rotation,
+  // org is the index of the (sorted) origin vertex of primal edges
+  static int32_t rot    (int32_t e) { return (e&~3)|((e+1)&3); }
+  static int32_t sym    (int32_t e) { return (e&~3)|((e+2)&3); }
+  static int32_t invRot (int32_t e) { return (e&~3)|((e+3)&3); }
+  int32_t onext  (int32_t e) const { return next[e]; }
+  int32_t oprev  (int32_t e) const { return rot(next[rot(e)]); }
+  int32_t lnext  (int32_t e) const { return rot(next[invRot(e)]); }
+  int32_t rprev  (int32_t e) const { return next[sym(e)]; }
+  int32_t lprev  (int32_t e) const { return sym(next[e]); }
+  int32_t dprev  (int32_t e) const { return invRot(next[invRot(e)]); }
+  int32_t dest   (int32_t e) const { return org[sym(e)]; }
+
+  int32_t makeEdge (int32_t a,int32_t b);
+  void    splice (int32_t a,int32_t b);
+  int32_t connect (int32_t a,int32_t b);
+  void    deleteEdge (int32_t e);
+  void    swapEdge (int32_t e);
+
+  // exact predicates on sorted vertices
+  int64_t ccw (int32_t a,int32_t b,int32_t c) const;
+  bool    inCircle (int32_t a,int32_t b,int32_t c,int32_t d) const;
+  bool    rightOf (int32_t x,int32_t e) const { return ccw(x,dest(e),org[e])>0; }
+  bool    leftOf (int32_t x,int32_t e) const { return ccw(x,org[e],dest(e))>0; }
+
+  // triangulates the sorted vertices lo..hi-1, returns the counterclockwise
+  // convex hull edge out of the leftmost (le) and the clockwise one out of
+  // the rightmost vertex (re)
+  void build (int32_t lo,int32_t hi,int32_t &le,int32_t &re);
+
+  // sorts the points by (u,v) into order, returns false if their
+  // coordinates exceed max_range
+  bool sortPoints (const int32_t* points,int32_t n);
+
+  // marks the vertices and stores the edges of the convex hull
+  void findHull (int32_t le);
+
+  // writes the bounded faces to tri
+  void collectTriangles (std::vector<int32_t> &tri);
+
+  // local changes of update(), they return false if the triangulation is
+  // not as expected (then it is built again)
+  int32_t locate (int32_t v);
+  bool    removeVertex (int32_t v);
+  bool    insertVertex (int32_t v);
+
+  // vertices and their indices in the input (sorted and unique after
+  // triangulate(), update() deletes and appends vertices)
+  std::vector<int32_t> x,y,id;
+
+  // the edges triangulate the vertices of the last call
+  bool valid;
+
+  // update(): vertices in (u,v) order, hull vertices, hull edges (outer
+  // face on the left), unused vertices and the changes of a call
+  std::vector<int32_t> sorted,sorted_tmp,hull_edges,free_vertices,removed,added;
+  std::vector<uint8_t> on_hull;
+
+  // removeVertex(): edges out of the vertex and boundary of the hole
+  std::vector<int32_t> star,hole;
+
+  // edges (4 per quad, free quads are listed in free_quads)
+  std::vector<int32_t> next,org,free_quads;
+
+  // radix sort buffers
+  std::vector<int32_t> count,order,order_tmp;
+};
+
+#endif
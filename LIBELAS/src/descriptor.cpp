@@ -25,90 +25,126 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 
 using namespace std;
 
-Descriptor::Descriptor(uint8_t* I,int32_t width,int32_t height,int32_t bpl,bool half_resolution) {
-  I_desc        = (uint8_t*)_mm_malloc(16*width*height*sizeof(uint8_t),16);
-  uint8_t* I_du = (uint8_t*)_mm_malloc(bpl*height*sizeof(uint8_t),16);
-  uint8_t* I_dv = (uint8_t*)_mm_malloc(bpl*height*sizeof(uint8_t),16);
-  filter::sobel3x3(I,I_du,I_dv,bpl,height);
-  createDescriptor(I_du,I_dv,width,height,bpl,half_resolution);
-  _mm_free(I_du);
-  _mm_free(I_dv);
+Descriptor::Descriptor() : I_desc(0),I_du(0),I_dv(0),width(0),height(0),bpl(0) {}
+
+Descriptor::Descriptor(uint8_t* I,int32_t width,int32_t height,int32_t bpl,bool half_resolution) :
+  I_desc(0),I_du(0),I_dv(0),width(0),height(0),bpl(0) {
+  compute(I,width,height,bpl,half_resolution);
 }
 
 Descriptor::~Descriptor() {
   _mm_free(I_desc);
+  _mm_free(I_du);
+  _mm_free(I_dv);
+}
+
+void Descriptor::compute(uint8_t* I,int32_t width,int32_t height,int32_t bpl,bool half_resolution) {
+
+  // (re-)allocate memory if dimensions have changed
+  if (width!=this->width || height!=this->height || bpl!=this->bpl) {
+    _mm_free(I_desc);
+    _mm_free(I_du);
+    _mm_free(I_dv);
+    I_desc = (uint8_t*)_mm_malloc(16*width*height*sizeof(uint8_t),16);
+    I_du   = (uint8_t*)_mm_malloc(5*bpl*sizeof(uint8_t),16);
+    I_dv   = (uint8_t*)_mm_malloc(5*bpl*sizeof(uint8_t),16);
+
+    // border descriptors are never written, hence zero them once
+    memset(I_desc,0,16*width*height*sizeof(uint8_t));
+    this->width  = width;
+    this->height = height;
+    this->bpl    = bpl;
+  }
+
+  createDescriptor(I,width,height,bpl,half_resolution);
 }
 
-void Descriptor::createDescriptor (uint8_t* I_du,uint8_t* I_dv,int32_t width,int32_t height,int32_t bpl,bool half_resolution) {
+void Descriptor::createDescriptor (uint8_t* I,int32_t width,int32_t height,int32_t bpl,bool half_resolution) {
+
+  uint8_t *I_desc_curr;
+  uint8_t *du_0,*du_1,*du_2,*du_3,*du_4,*dv_1,*dv_2,*dv_3;
 
-  uint8_t *I_desc_curr;  
-  uint32_t addr_v0,addr_v1,addr_v2,addr_v3,addr_v4;
-  
   // do not compute every second line
-  if (half_resolution) {
-  
-    // create filter strip
-    for (int32_t v=4; v<height-3; v+=2) {
-
-      addr_v2 = v*bpl;
-      addr_v0 = addr_v2-2*bpl;
-      addr_v1 = addr_v2-1*bpl;
-      addr_v3 = addr_v2+1*bpl;
-      addr_v4 = addr_v2+2*bpl;
-
-      for (int32_t u=3; u<width-3; u++) {
-        I_desc_curr = I_desc+(v*width+u)*16;
-        *(I_desc_curr++) = *(I_du+addr_v0+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v1+u-2);
-        *(I_desc_curr++) = *(I_du+addr_v1+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v1+u+2);
-        *(I_desc_curr++) = *(I_du+addr_v2+u-1);
-        *(I_desc_curr++) = *(I_du+addr_v2+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v2+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v2+u+1);
-        *(I_desc_curr++) = *(I_du+addr_v3+u-2);
-        *(I_desc_curr++) = *(I_du+addr_v3+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v3+u+2);
-        *(I_desc_curr++) = *(I_du+addr_v4+u+0);
-        *(I_desc_curr++) = *(I_dv+addr_v1+u+0);
-        *(I_desc_curr++) = *(I_dv+addr_v2+u-1);
-        *(I_desc_curr++) = *(I_dv+addr_v2+u+1);
-        *(I_desc_curr++) = *(I_dv+addr_v3+u+0);
+  int32_t v_start = half_resolution ? 4 : 3;
+  int32_t v_step  = half_resolution ? 2 : 1;
+
+  // next row of sobel responses to compute
+  int32_t r_next = v_start-2;
+
+  // create filter strip
+  for (int32_t v=v_start; v<height-3; v+=v_step) {
+
+    // sobel responses of rows v-2..v+2, older rows are overwritten
+    for (; r_next<=v+2; r_next++)
+      filter::sobel3x3_row(I+r_next*bpl,I_du+(r_next%5)*bpl,I_dv+(r_next%5)*bpl,width,bpl);
+
+    du_0 = I_du+((v-2)%5)*bpl;
+    du_1 = I_du+((v-1)%5)*bpl;
+    du_2 = I_du+((v+0)%5)*bpl;
+    du_3 = I_du+((v+1)%5)*bpl;
+    du_4 = I_du+((v+2)%5)*bpl;
+    dv_1 = I_dv+((v-1)%5)*bpl;
+    dv_2 = I_dv+((v+0)%5)*bpl;
+    dv_3 = I_dv+((v+1)%5)*bpl;
+
+    // 16 descriptors per iteration: load the 16 descriptor elements of 16
+    // consecutive pixels and transpose the 16x16 byte block
+    int32_t u = 3;
+    for (; u+16<=width-3; u+=16) {
+      __m128i xmm[16],xmm_tmp[16];
+      xmm[0]  = _mm_loadu_si128((__m128i*)(du_0+u+0));
+      xmm[1]  = _mm_loadu_si128((__m128i*)(du_1+u-2));
+      xmm[2]  = _mm_loadu_si128((__m128i*)(du_1+u+0));
+      xmm[3]  = _mm_loadu_si128((__m128i*)(du_1+u+2));
+      xmm[4]  = _mm_loadu_si128((__m128i*)(du_2+u-1));
+      xmm[5]  = _mm_loadu_si128((__m128i*)(du_2+u+0));
+      xmm[6]  = xmm[5];
+      xmm[7]  = _mm_loadu_si128((__m128i*)(du_2+u+1));
+      xmm[8]  = _mm_loadu_si128((__m128i*)(du_3+u-2));
+      xmm[9]  = _mm_loadu_si128((__m128i*)(du_3+u+0));
+      xmm[10] = _mm_loadu_si128((__m128i*)(du_3+u+2));
+      xmm[11] = _mm_loadu_si128((__m128i*)(du_4+u+0));
+      xmm[12] = _mm_loadu_si128((__m128i*)(dv_1+u+0));
+      xmm[13] = _mm_loadu_si128((__m128i*)(dv_2+u-1));
+      xmm[14] = _mm_loadu_si128((__m128i*)(dv_2+u+1));
+      xmm[15] = _mm_loadu_si128((__m128i*)(dv_3+u+0));
+
+      // each interleave of rows i and i+8 rotates the (row,column) bits of
+      // the byte index by one, hence four of them transpose the block
+      for (int32_t k=0; k<4; k++) {
+        for (int32_t i=0; i<8; i++) {
+          xmm_tmp[2*i+0] = _mm_unpacklo_epi8(xmm[i],xmm[i+8]);
+          xmm_tmp[2*i+1] = _mm_unpackhi_epi8(xmm[i],xmm[i+8]);
+        }
+        for (int32_t i=0; i<16; i++)
+          xmm[i] = xmm_tmp[i];
       }
+
+      I_desc_curr = I_desc+(v*width+u)*16;
+      for (int32_t i=0; i<16; i++)
+        _mm_store_si128((__m128i*)(I_desc_curr+16*i),xmm[i]);
     }
-    
-  // compute full descriptor images
-  } else {
-    
-    // create filter strip
-    for (int32_t v=3; v<height-3; v++) {
-
-      addr_v2 = v*bpl;
-      addr_v0 = addr_v2-2*bpl;
-      addr_v1 = addr_v2-1*bpl;
-      addr_v3 = addr_v2+1*bpl;
-      addr_v4 = addr_v2+2*bpl;
-
-      for (int32_t u=3; u<width-3; u++) {
-        I_desc_curr = I_desc+(v*width+u)*16;
-        *(I_desc_curr++) = *(I_du+addr_v0+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v1+u-2);
-        *(I_desc_curr++) = *(I_du+addr_v1+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v1+u+2);
-        *(I_desc_curr++) = *(I_du+addr_v2+u-1);
-        *(I_desc_curr++) = *(I_du+addr_v2+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v2+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v2+u+1);
-        *(I_desc_curr++) = *(I_du+addr_v3+u-2);
-        *(I_desc_curr++) = *(I_du+addr_v3+u+0);
-        *(I_desc_curr++) = *(I_du+addr_v3+u+2);
-        *(I_desc_curr++) = *(I_du+addr_v4+u+0);
-        *(I_desc_curr++) = *(I_dv+addr_v1+u+0);
-        *(I_desc_curr++) = *(I_dv+addr_v2+u-1);
-        *(I_desc_curr++) = *(I_dv+addr_v2+u+1);
-        *(I_desc_curr++) = *(I_dv+addr_v3+u+0);
-      }
+
+    // remaining pixels
+    for (; u<width-3; u++) {
+      I_desc_curr = I_desc+(v*width+u)*16;
+      *(I_desc_curr++) = *(du_0+u+0);
+      *(I_desc_curr++) = *(du_1+u-2);
+      *(I_desc_curr++) = *(du_1+u+0);
+      *(I_desc_curr++) = *(du_1+u+2);
+      *(I_desc_curr++) = *(du_2+u-1);
+      *(I_desc_curr++) = *(du_2+u+0);
+      *(I_desc_curr++) = *(du_2+u+0);
+      *(I_desc_curr++) = *(du_2+u+1);
+      *(I_desc_curr++) = *(du_3+u-2);
+      *(I_desc_curr++) = *(du_3+u+0);
+      *(I_desc_curr++) = *(du_3+u+2);
+      *(I_desc_curr++) = *(du_4+u+0);
+      *(I_desc_curr++) = *(dv_1+u+0);
+      *(I_desc_curr++) = *(dv_2+u-1);
+      *(I_desc_curr++) = *(dv_2+u+1);
+      *(I_desc_curr++) = *(dv_3+u+0);
     }
   }
-  
+
 }
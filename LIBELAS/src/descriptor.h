@@ -50,19 +50,38 @@ class Descriptor {
   
 public:
   
+  // default constructor, descriptors are computed later via compute()
+  Descriptor();
+
   // constructor creates filters
   Descriptor(uint8_t* I,int32_t width,int32_t height,int32_t bpl,bool half_resolution);
   
   // deconstructor releases memory
   ~Descriptor();
   
+  // computes the descriptors of image I, memory is only
+  // reallocated if the image dimensions have changed
+  void compute(uint8_t* I,int32_t width,int32_t height,int32_t bpl,bool half_resolution);
+  
   // descriptors accessible from outside
   uint8_t* I_desc;
   
 private:
 
-  // build descriptor I_desc from I_du and I_dv
-  void createDescriptor(uint8_t* I_du,uint8_t* I_dv,int32_t width,int32_t height,int32_t bpl,bool half_resolution);
+  // descriptors own their memory, hence no copies
+  Descriptor(const Descriptor&);
+  Descriptor& operator=(const Descriptor&);
+
+  // sobel responses of the last 5 image rows (row v in line v%5),
+  // reused across calls to compute()
+  uint8_t *I_du,*I_dv;
+
+  // dimensions of the allocated memory
+  int32_t width,height,bpl;
+
+  // build descriptor I_desc from image I in a single pass: the sobel
+  // responses are computed row by row into I_du and I_dv as they are needed
+  void createDescriptor(uint8_t* I,int32_t width,int32_t height,int32_t bpl,bool half_resolution);
 
 };
 
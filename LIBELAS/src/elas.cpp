@@ -23,116 +23,199 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 
 #include <math.h>
 #include <omp.h>
+#include <chrono>
 #include "descriptor.h"
 #include "triangle.h"
-#include "matrix.h"
+#include "matching.h"
 
 using namespace std;
 
-void Elas::process (uint8_t* I1_,uint8_t* I2_,float* D1,float* D2,const int32_t* dims){
+Elas::Elas (parameters param) : param(param),I1(0),I2(0),width(0),height(0),bpl(0),ws_width(0),ws_height(0),
+	I1_aligned(0),I2_aligned(0),D_can(0),D_can_prev(0),temporal_valid(false),temporal_frame(0),
+	P(0),D_temp(0),D1_dense(0),D2_dense(0),seg_parent(0) {
+	grid_temp[0] = grid_temp[1] = 0;
+	tri_engine[0] = triangulateenginenew();
+	tri_engine[1] = triangulateenginenew();
+}
+
+Elas::~Elas () {
+	releaseWorkspace();
+	triangulateenginefree(tri_engine[0]);
+	triangulateenginefree(tri_engine[1]);
+}
+
+int32_t Elas::getNumThreads () {
+	if (param.num_threads>0)
+		return param.num_threads;
+	return omp_get_max_threads();
+}
+
+Elas::stats Elas::process (uint8_t* I1_,uint8_t* I2_,float* D1,float* D2,const int32_t* dims,
+		const float* D1_prev,const float* D2_prev){
+	processImages(I1_,I2_,D1,D2,dims,false,D1_prev,D2_prev);
+	return stat;
+}
+
+Elas::stats Elas::processInPlace (uint8_t* I1_,uint8_t* I2_,float* D1,float* D2,const int32_t* dims,
+		const float* D1_prev,const float* D2_prev){
+
+	// images can be used directly if they are aligned and each line is padded
+	bool aligned = ((uintptr_t)I1_)%16==0 && ((uintptr_t)I2_)%16==0;
+	bool padded  = dims[2]%16==0 && dims[2]>=dims[0];
+	processImages(I1_,I2_,D1,D2,dims,aligned && padded,D1_prev,D2_prev);
+	return stat;
+}
+
+void Elas::resetTemporal () {
+	temporal_valid = false;
+}
+
+double Elas::getLapTime (double &t) {
+	double t_prev = t;
+	t = chrono::duration<double,milli>(chrono::steady_clock::now().time_since_epoch()).count();
+	return t-t_prev;
+}
+
+void Elas::processImages (uint8_t* I1_,uint8_t* I2_,float* D1,float* D2,const int32_t* dims,bool in_place,
+		const float* D1_prev,const float* D2_prev){
+
+	// reset statistics and start timing
+	double t_start = 0,t_stage;
+	getLapTime(t_start);
+	t_stage = t_start;
+	stat    = stats();
 
 	// get width, height and bytes per line
 	width  = dims[0];
 	height = dims[1];
-	bpl    = width + 15-(width-1)%16;
-
-	// copy images to byte aligned memory
-	I1 = (uint8_t*)_mm_malloc(bpl*height*sizeof(uint8_t),16);
-	I2 = (uint8_t*)_mm_malloc(bpl*height*sizeof(uint8_t),16);
-	memset (I1,0,bpl*height*sizeof(uint8_t));
-	memset (I2,0,bpl*height*sizeof(uint8_t));
-	if (bpl==dims[2]) {
-		memcpy(I1,I1_,bpl*height*sizeof(uint8_t));
-		memcpy(I2,I2_,bpl*height*sizeof(uint8_t));
+	if (in_place) bpl = dims[2];
+	else          bpl = width + 15-(width-1)%16;
+
+	// (re-)allocate workspace if the image dimensions have changed
+	if (width!=ws_width || height!=ws_height)
+		allocateWorkspace();
+
+	// read images in place
+	if (in_place) {
+		I1 = I1_;
+		I2 = I2_;
+
+	// or copy images to byte aligned memory
 	} else {
-		for (int32_t v=0; v<height; v++) {
-			memcpy(I1+v*bpl,I1_+v*dims[2],width*sizeof(uint8_t));
-			memcpy(I2+v*bpl,I2_+v*dims[2],width*sizeof(uint8_t));
+		if (I1_aligned==0) {
+			I1_aligned = (uint8_t*)_mm_malloc(bpl*height*sizeof(uint8_t),16);
+			I2_aligned = (uint8_t*)_mm_malloc(bpl*height*sizeof(uint8_t),16);
+			memset(I1_aligned,0,bpl*height*sizeof(uint8_t));
+			memset(I2_aligned,0,bpl*height*sizeof(uint8_t));
+		}
+		I1 = I1_aligned;
+		I2 = I2_aligned;
+		if (bpl==dims[2]) {
+			memcpy(I1,I1_,bpl*height*sizeof(uint8_t));
+			memcpy(I2,I2_,bpl*height*sizeof(uint8_t));
+		} else {
+			for (int32_t v=0; v<height; v++) {
+				memcpy(I1+v*bpl,I1_+v*dims[2],width*sizeof(uint8_t));
+				memcpy(I2+v*bpl,I2_+v*dims[2],width*sizeof(uint8_t));
+			}
 		}
 	}
 
-	// allocate memory for disparity grid
+	// previous disparity maps (not used if prior_radius is 0). if they are the
+	// output maps themselves, the dense matching writes to the workspace
+	// instead and the l/r check moves its result to D1 and D2
+	if (param.prior_radius<=0)
+		D1_prev = D2_prev = 0;
+	float* D1_match = D1;
+	float* D2_match = D2;
+	if ((D1_prev!=0 && (D1_prev==D1 || D1_prev==D2)) || (D2_prev!=0 && (D2_prev==D1 || D2_prev==D2))) {
+		int32_t D_size = param.subsampling ? (width/2)*(height/2) : width*height;
+		if (D1_dense==0) {
+			D1_dense = (float*)malloc(D_size*sizeof(float));
+			D2_dense = (float*)malloc(D_size*sizeof(float));
+		}
+		D1_match = D1_dense;
+		D2_match = D2_dense;
+	}
+
+	// disparity grid dimensions
 	int32_t grid_width   = (int32_t)ceil((float)width/(float)param.grid_size);
 	int32_t grid_height  = (int32_t)ceil((float)height/(float)param.grid_size);
 	int32_t grid_dims[3] = {param.disp_max+2,grid_width,grid_height};
-	int32_t* disparity_grid_1 = (int32_t*)calloc((param.disp_max+2)*grid_height*grid_width,sizeof(int32_t));
-	int32_t* disparity_grid_2 = (int32_t*)calloc((param.disp_max+2)*grid_height*grid_width,sizeof(int32_t));
-
-#ifdef PROFILE
-	timer.start("Descriptor");
-#endif
-	Descriptor desc1(I1,width,height,bpl,param.subsampling);
-	Descriptor desc2(I2,width,height,bpl,param.subsampling);
-
-#ifdef PROFILE
-	timer.start("Support Matches");
-#endif
-	vector<support_pt> p_support = computeSupportMatches(desc1.I_desc,desc2.I_desc);
-
-#ifdef PROFILE
-	timer.start("Parallel Region #1 = {Delaunay Triangulation, Disparity Planes, Grid}");
-#endif
-
-vector<triangle> tri_1, tri_2;
-#pragma omp parallel num_threads(2)
+
+	getLapTime(t_stage);
+	// the two-way sections run on the full team as well: a team that shrinks
+	// and grows again between regions makes the runtime respawn its threads
+#pragma omp parallel num_threads(getNumThreads())
 	{
 #pragma omp sections
 		{
 #pragma omp section
-			{
-				tri_1 = computeDelaunayTriangulation(p_support,0);
-				computeDisparityPlanes(p_support,tri_1,0);
-				createGrid(p_support,disparity_grid_1,grid_dims,0);
-				//computeDisparity(p_support,tri_1,disparity_grid_1,grid_dims,desc1.I_desc,desc2.I_desc,0,D1);
-			}
+			desc1.compute(I1,width,height,bpl,param.subsampling);
 #pragma omp section
-			{
-				tri_2 = computeDelaunayTriangulation(p_support,1);
-				computeDisparityPlanes(p_support,tri_2,1);
-				createGrid(p_support,disparity_grid_2,grid_dims,1);
-				//computeDisparity(p_support,tri_2,disparity_grid_2,grid_dims,desc1.I_desc,desc2.I_desc,1,D2);
-			}
-
+			desc2.compute(I2,width,height,bpl,param.subsampling);
 		}
 	}
+	stat.descriptor = getLapTime(t_stage);
 
-#ifdef PROFILE
-	timer.start("Matching");
-#endif
+	vector<support_pt> &p_support = support_points;
+	computeSupportMatches(desc1.I_desc,desc2.I_desc,p_support);
+	stat.num_support_points = p_support.size();
+	stat.support_matches    = getLapTime(t_stage);
 
+	vector<triangle> &tri_1 = triangles[0];
+	vector<triangle> &tri_2 = triangles[1];
+#pragma omp parallel num_threads(getNumThreads())
+	{
 #pragma omp sections
+		{
+#pragma omp section
+			computeDelaunayTriangulation(p_support,tri_1,0);
+#pragma omp section
+			computeDelaunayTriangulation(p_support,tri_2,1);
+		}
+	}
+	computeDisparityPlanes(p_support,tri_1,0);
+	computeDisparityPlanes(p_support,tri_2,1);
+	stat.num_triangles = tri_1.size()+tri_2.size();
+	stat.triangulation = getLapTime(t_stage);
+
+	// the support points and triangulations of this frame seed the next one
+	temporal_frame = temporal_valid ? temporal_frame+1 : 0;
+	temporal_valid = param.temporal_support;
+
+#pragma omp parallel num_threads(getNumThreads())
 	{
-	#pragma omp section
-		computeDisparity(p_support,tri_1,disparity_grid_1,grid_dims,desc1.I_desc,desc2.I_desc,0,D1);
-	#pragma omp section
-		computeDisparity(p_support,tri_2,disparity_grid_2,grid_dims,desc1.I_desc,desc2.I_desc,1,D2);
+#pragma omp sections
+		{
+#pragma omp section
+			createGrid(p_support,disparity_grid_1,grid_dims,0);
+#pragma omp section
+			createGrid(p_support,disparity_grid_2,grid_dims,1);
+		}
 	}
+	stat.grid = getLapTime(t_stage);
 
-#ifdef PROFILE
-	timer.start("L/R Consistency Check");
-#endif
-	leftRightConsistencyCheck(D1,D2);
+	computeDisparity(p_support,tri_1,disparity_grid_1,grid_dims,desc1.I_desc,desc2.I_desc,0,D1_match,D1_prev);
+	computeDisparity(p_support,tri_2,disparity_grid_2,grid_dims,desc1.I_desc,desc2.I_desc,1,D2_match,D2_prev);
+	stat.matching = getLapTime(t_stage);
+
+	stat.num_invalid_lr = leftRightConsistencyCheck(D1_match,D2_match,D1,D2);
+	stat.lr_check       = getLapTime(t_stage);
 
-#ifdef PROFILE
-	timer.start("Remove Small Segments");
-#endif
 	if (!param.postprocess_only_left)
-		removeSmallSegments(D2);
+		stat.num_invalid_segments = removeSmallSegments(D2);
 	else
-		removeSmallSegments(D1);
+		stat.num_invalid_segments = removeSmallSegments(D1);
+	stat.remove_small_segments = getLapTime(t_stage);
 
-#ifdef PROFILE
-	timer.start("Gap Interpolation");
-#endif
 	if (!param.postprocess_only_left)
 		gapInterpolation(D2);
 	else
 		gapInterpolation(D1);
+	stat.gap_interpolation = getLapTime(t_stage);
 
 	if (param.filter_adaptive_mean) {
-#ifdef PROFILE
-		timer.start("Adaptive Mean");
-#endif
 		if (!param.postprocess_only_left)
 			adaptiveMean(D2);
 		else
@@ -140,30 +223,92 @@ vector<triangle> tri_1, tri_2;
 	}
 
 	if (param.filter_median) {
-#ifdef PROFILE
-		timer.start("Median");
-#endif
 		if (!param.postprocess_only_left)
 			median(D2);
 		else
 			median(D1);
 	}
+	stat.filtering = getLapTime(t_stage);
+	stat.total     = t_stage-t_start;
+}
+
+void Elas::allocateWorkspace () {
+
+	// release old memory
+	releaseWorkspace();
+
+	// disparity image dimensions
+	int32_t D_width  = width;
+	int32_t D_height = height;
+	if (param.subsampling) {
+		D_width  = width/2;
+		D_height = height/2;
+	}
+
+	// disparity grids (uint16 lists, hence disp_max<65535, the packed lists
+	// grow with the number of disparities) and bitsets of createGrid()
+	int32_t grid_width  = (int32_t)ceil((float)width/(float)param.grid_size);
+	int32_t grid_height = (int32_t)ceil((float)height/(float)param.grid_size);
+	disparity_grid_1.offset.resize(grid_width*grid_height+1);
+	disparity_grid_2.offset.resize(grid_width*grid_height+1);
+	for (int32_t i=0; i<2; i++)
+		grid_temp[i] = (uint64_t*)calloc(getGridWords()*grid_height*grid_width,sizeof(uint64_t));
+
+	// support point candidates
+	int32_t D_candidate_stepsize = param.candidate_stepsize;
+	if (param.subsampling)
+		D_candidate_stepsize += D_candidate_stepsize%2;
+	int32_t D_can_width  = 0;
+	int32_t D_can_height = 0;
+	for (int32_t u=0; u<width;  u+=D_candidate_stepsize) D_can_width++;
+	for (int32_t v=0; v<height; v+=D_candidate_stepsize) D_can_height++;
+	D_can = (int16_t*)calloc(D_can_width*D_can_height,sizeof(int16_t));
+	D_can_prev = (int16_t*)calloc(D_can_width*D_can_height,sizeof(int16_t));
+	temporal_valid = false;
+
+	// pre-compute prior
+	int32_t disp_num = param.disp_max+1;
+	float two_sigma_squared = 2*param.sigma*param.sigma;
+	P = (int32_t*)malloc(disp_num*sizeof(int32_t));
+	for (int32_t delta_d=0; delta_d<disp_num; delta_d++)
+		P[delta_d] = (int32_t)((-log(param.gamma+exp(-delta_d*delta_d/two_sigma_squared))+log(param.gamma))/param.beta);
+
+	// post-processing memory
+	D_temp     = (float*)calloc(D_width*D_height,sizeof(float));
+	seg_parent = (int32_t*)malloc(D_width*D_height*sizeof(int32_t));
 
-#ifdef PROFILE
-	timer.plot();
-#endif
+	// remember workspace dimensions
+	ws_width  = width;
+	ws_height = height;
+}
 
-	// release memory
-	free(disparity_grid_1);
-	free(disparity_grid_2);
-	_mm_free(I1);
-	_mm_free(I2);
+void Elas::releaseWorkspace () {
+	_mm_free(I1_aligned);
+	_mm_free(I2_aligned);
+	for (int32_t i=0; i<2; i++)
+		free(grid_temp[i]);
+	free(D_can);
+	free(D_can_prev);
+	free(P);
+	free(D_temp);
+	free(D1_dense);
+	free(D2_dense);
+	free(seg_parent);
+	I1_aligned = I2_aligned = 0;
+	grid_temp[0] = grid_temp[1] = 0;
+	D_can = D_can_prev = 0;
+	P = 0;
+	D_temp = 0;
+	D1_dense = D2_dense = 0;
+	seg_parent = 0;
+	ws_width = ws_height = 0;
 }
 
+
+
 void Elas::removeInconsistentSupportPoints (int16_t* D_can,int32_t D_can_width,int32_t D_can_height) {
 
 	// for all valid support points do
-	#pragma omp for
 	for (int32_t u_can=0; u_can<D_can_width; u_can++) {
 		for (int32_t v_can=0; v_can<D_can_height; v_can++) {
 			int16_t d_can = *(D_can+getAddressOffsetImage(u_can,v_can,D_can_width));
@@ -204,7 +349,6 @@ void Elas::removeRedundantSupportPoints(int16_t* D_can,int32_t D_can_width,int32
 	}
 
 	// for all valid support points do
-	#pragma omp for
 	for (int32_t u_can=0; u_can<D_can_width; u_can++) {
 		for (int32_t v_can=0; v_can<D_can_height; v_can++) {
 			int16_t d_can = *(D_can+getAddressOffsetImage(u_can,v_can,D_can_width));
@@ -248,15 +392,13 @@ void Elas::removeRedundantSupportPoints(int16_t* D_can,int32_t D_can_width,int32
 
 void Elas::addCornerSupportPoints(vector<support_pt> &p_support) {
 
-	// list of border points
-	vector<support_pt> p_border;
-	p_border.push_back(support_pt(0,0,0));
-	p_border.push_back(support_pt(0,height-1,0));
-	p_border.push_back(support_pt(width-1,0,0));
-	p_border.push_back(support_pt(width-1,height-1,0));
+	// list of border points (the last two are set below)
+	support_pt p_border[6] = {support_pt(0,0,0),support_pt(0,height-1,0),
+	                          support_pt(width-1,0,0),support_pt(width-1,height-1,0),
+	                          support_pt(0,0,0),support_pt(0,0,0)};
 
 	// find closest d
-	for (int32_t i=0; i<p_border.size(); i++) {
+	for (int32_t i=0; i<4; i++) {
 		int32_t best_dist = 10000000;
 		for (int32_t j=0; j<p_support.size(); j++) {
 			int32_t du = p_border[i].u-p_support[j].u;
@@ -270,26 +412,25 @@ void Elas::addCornerSupportPoints(vector<support_pt> &p_support) {
 	}
 
 	// for right image
-	p_border.push_back(support_pt(p_border[2].u+p_border[2].d,p_border[2].v,p_border[2].d));
-	p_border.push_back(support_pt(p_border[3].u+p_border[3].d,p_border[3].v,p_border[3].d));
+	p_border[4] = support_pt(p_border[2].u+p_border[2].d,p_border[2].v,p_border[2].d);
+	p_border[5] = support_pt(p_border[3].u+p_border[3].d,p_border[3].v,p_border[3].d);
 
 	// add border points to support points
-	for (int32_t i=0; i<p_border.size(); i++)
+	for (int32_t i=0; i<6; i++)
 		p_support.push_back(p_border[i]);
 }
 
-inline int16_t Elas::computeMatchingDisparity (const int32_t &u,const int32_t &v,uint8_t* I1_desc,uint8_t* I2_desc,const bool &right_image) {
+inline int16_t Elas::computeMatchingDisparity (const int32_t &u,const int32_t &v,uint8_t* I1_desc,uint8_t* I2_desc,const bool &right_image,
+		int64_t &num_sad,const int32_t d_search_min,const int32_t d_search_max) {
 
 	const int32_t u_step      = 2;
 	const int32_t v_step      = 2;
 	const int32_t window_size = 3;
 
-	int32_t desc_offset_1 = -16*u_step-16*width*v_step;
-	int32_t desc_offset_2 = +16*u_step-16*width*v_step;
-	int32_t desc_offset_3 = -16*u_step+16*width*v_step;
-	int32_t desc_offset_4 = +16*u_step+16*width*v_step;
-
-	__m128i xmm1,xmm2,xmm3,xmm4,xmm5,xmm6;
+	int32_t desc_offset[4] = {-16*u_step-16*width*v_step,
+	                          +16*u_step-16*width*v_step,
+	                          -16*u_step+16*width*v_step,
+	                          +16*u_step+16*width*v_step};
 
 	// check if we are inside the image region
 	if (u>=window_size+u_step && u<=width-window_size-1-u_step && v>=window_size+v_step && v<=height-window_size-1-v_step) {
@@ -316,20 +457,28 @@ inline int16_t Elas::computeMatchingDisparity (const int32_t &u,const int32_t &v
 		if (sum<param.support_texture)
 			return -1;
 
-		// load first blocks to xmm registers
-		xmm1 = _mm_load_si128((__m128i*)(I1_block_addr+desc_offset_1));
-		xmm2 = _mm_load_si128((__m128i*)(I1_block_addr+desc_offset_2));
-		xmm3 = _mm_load_si128((__m128i*)(I1_block_addr+desc_offset_3));
-		xmm4 = _mm_load_si128((__m128i*)(I1_block_addr+desc_offset_4));
-
-		// declare match energy for each disparity
-		int32_t u_warp;
-
-		// best match
-		int16_t min_1_E = 32767;
-		int16_t min_1_d = -1;
-		int16_t min_2_E = 32767;
-		int16_t min_2_d = -1;
+		// match energies of a chunk of disparities (as int16 in ascending disparity
+		// order, padded to a multiple of 8 with 32767, costs never exceed 4*16*255)
+		const int32_t chunk = 64;
+		int32_t cost[chunk];
+		__m128i xcost_mem[chunk/8];
+		int16_t *cost16 = (int16_t*)xcost_mem;
+
+		// best + second best match, branch free over 8 disparities per register.
+		// min_1 is the first minimum, min_2 the minimum of all energies which are
+		// not below every energy of a smaller disparity (the if/else-if tracking
+		// never moves the old best match to the second best one). per lane:
+		// xmin_1/xmin_1_d best energy + disparity, xmin_2 second best energy,
+		// xprefix_min: minimum energy of all smaller disparities (broadcast)
+		const __m128i xmax   = _mm_set1_epi16(32767);
+		const __m128i xfill1 = _mm_setr_epi16(32767,0,0,0,0,0,0,0);
+		const __m128i xfill2 = _mm_setr_epi16(32767,32767,0,0,0,0,0,0);
+		const __m128i xfill4 = _mm_setr_epi16(32767,32767,32767,32767,0,0,0,0);
+		const __m128i xlane  = _mm_setr_epi16(0,1,2,3,4,5,6,7);
+		__m128i xmin_1      = xmax;
+		__m128i xmin_1_d    = _mm_set1_epi16(-1);
+		__m128i xmin_2      = xmax;
+		__m128i xprefix_min = xmax;
 
 		// get valid disparity range
 		int32_t disp_min_valid = max(param.disp_min,0);
@@ -341,39 +490,83 @@ inline int16_t Elas::computeMatchingDisparity (const int32_t &u,const int32_t &v
 		if (disp_max_valid-disp_min_valid<10)
 			return -1;
 
-		// for all disparities do
-		for (int16_t d=disp_min_valid; d<=disp_max_valid; d++) {
-
-			// warp u coordinate
-			if (!right_image) u_warp = u-d;
-			else              u_warp = u+d;
-
-			// compute I2 block start addresses
-			I2_block_addr = I2_line_addr+16*u_warp;
-
-			// compute match energy at this disparity
-			xmm6 = _mm_load_si128((__m128i*)(I2_block_addr+desc_offset_1));
-			xmm6 = _mm_sad_epu8(xmm1,xmm6);
-			xmm5 = _mm_load_si128((__m128i*)(I2_block_addr+desc_offset_2));
-			xmm6 = _mm_add_epi16(_mm_sad_epu8(xmm2,xmm5),xmm6);
-			xmm5 = _mm_load_si128((__m128i*)(I2_block_addr+desc_offset_3));
-			xmm6 = _mm_add_epi16(_mm_sad_epu8(xmm3,xmm5),xmm6);
-			xmm5 = _mm_load_si128((__m128i*)(I2_block_addr+desc_offset_4));
-			xmm6 = _mm_add_epi16(_mm_sad_epu8(xmm4,xmm5),xmm6);
-			sum  = _mm_extract_epi16(xmm6,0)+_mm_extract_epi16(xmm6,4);
-
-			// best + second best match
-			if (sum<min_1_E) {
-				min_1_E = sum;
-				min_1_d = d;
-			} else if (sum<min_2_E) {
-				min_2_E = sum;
-				min_2_d = d;
+		// search all valid disparities or only the given window
+		bool    windowed        = d_search_max>=0;
+		int32_t disp_min_search = disp_min_valid;
+		int32_t disp_max_search = disp_max_valid;
+		if (windowed) {
+			disp_min_search = max(disp_min_valid,d_search_min);
+			disp_max_search = min(disp_max_valid,d_search_max);
+		}
+
+		// for all chunks of disparities do
+		for (int32_t d_chunk=disp_min_search; d_chunk<=disp_max_search; d_chunk+=chunk) {
+			int32_t n = min(chunk,disp_max_search-d_chunk+1);
+
+			// compute match energies, the I2 blocks of consecutive disparities are
+			// consecutive in memory (in reverse order for the left image)
+			if (!right_image) I2_block_addr = I2_line_addr+16*(u-d_chunk-n+1);
+			else              I2_block_addr = I2_line_addr+16*(u+d_chunk);
+			matching::sadBlock4(I1_block_addr,I2_block_addr,desc_offset,n,cost);
+			num_sad += n;
+			int32_t k=0;
+			for (; k<n; k++)
+				cost16[k] = !right_image ? cost[n-1-k] : cost[k];
+			for (; k%8!=0; k++)
+				cost16[k] = 32767;
+
+			// for all disparities do (8 at a time)
+			for (k=0; k<n; k+=8) {
+				__m128i xc = xcost_mem[k/8];
+				__m128i xd = _mm_add_epi16(xlane,_mm_set1_epi16(d_chunk+k));
+
+				// best match (first occurrence per lane)
+				__m128i xbetter = _mm_cmplt_epi16(xc,xmin_1);
+				xmin_1   = _mm_min_epi16(xmin_1,xc);
+				xmin_1_d = _mm_or_si128(_mm_and_si128(xbetter,xd),_mm_andnot_si128(xbetter,xmin_1_d));
+
+				// prefix minimum (inclusive) within the register, then
+				// exclusive of the current disparity
+				__m128i xp = _mm_min_epi16(xc,_mm_or_si128(_mm_slli_si128(xc,2),xfill1));
+				xp = _mm_min_epi16(xp,_mm_or_si128(_mm_slli_si128(xp,4),xfill2));
+				xp = _mm_min_epi16(xp,_mm_or_si128(_mm_slli_si128(xp,8),xfill4));
+				xp = _mm_min_epi16(xp,xprefix_min);
+				__m128i xprev = _mm_min_epi16(_mm_or_si128(_mm_slli_si128(xp,2),xfill1),xprefix_min);
+
+				// second best match: energies which are no new best match
+				__m128i xrecord = _mm_cmplt_epi16(xc,xprev);
+				xmin_2 = _mm_min_epi16(xmin_2,_mm_or_si128(_mm_and_si128(xrecord,xmax),_mm_andnot_si128(xrecord,xc)));
+
+				// carry the prefix minimum (last lane) to the next disparities
+				xprefix_min = _mm_shufflehi_epi16(xp,0xFF);
+				xprefix_min = _mm_unpackhi_epi64(xprefix_min,xprefix_min);
 			}
 		}
 
+		// reduce lanes: smallest best energy, its smallest disparity, smallest second best energy
+		int16_t min_1_E = 32767;
+		int16_t min_1_d = -1;
+		int16_t min_2_E = 32767;
+		int16_t lane_min_1[8],lane_min_1_d[8],lane_min_2[8];
+		_mm_storeu_si128((__m128i*)lane_min_1,xmin_1);
+		_mm_storeu_si128((__m128i*)lane_min_1_d,xmin_1_d);
+		_mm_storeu_si128((__m128i*)lane_min_2,xmin_2);
+		for (int32_t i=0; i<8; i++) {
+			if (lane_min_1[i]<min_1_E || (lane_min_1[i]==min_1_E && lane_min_1_d[i]<min_1_d)) {
+				min_1_E = lane_min_1[i];
+				min_1_d = lane_min_1_d[i];
+			}
+			min_2_E = min(min_2_E,lane_min_2[i]);
+		}
+		bool min_2_valid = min_2_E<32767;
+
+		// a windowed search only succeeds for a minimum inside of the window
+		if (windowed && ((min_1_d==disp_min_search && disp_min_search>disp_min_valid) ||
+		                 (min_1_d==disp_max_search && disp_max_search<disp_max_valid)))
+			return -1;
+
 		// check if best and second best match are available and if matching ratio is sufficient
-		if (min_1_d>=0 && min_2_d>=0 && (float)min_1_E<param.support_threshold*(float)min_2_E)
+		if (min_1_d>=0 && min_2_valid && (float)min_1_E<param.support_threshold*(float)min_2_E)
 			return min_1_d;
 		else
 			return -1;
@@ -382,7 +575,7 @@ inline int16_t Elas::computeMatchingDisparity (const int32_t &u,const int32_t &v
 		return -1;
 }
 
-vector<Elas::support_pt> Elas::computeSupportMatches (uint8_t* I1_desc,uint8_t* I2_desc) {
+void Elas::computeSupportMatches (uint8_t* I1_desc,uint8_t* I2_desc,vector<support_pt> &p_support) {
 
 	// be sure that at half resolution we only need data
 	// from every second line!
@@ -395,44 +588,86 @@ vector<Elas::support_pt> Elas::computeSupportMatches (uint8_t* I1_desc,uint8_t*
 	int32_t D_can_height = 0;
 	for (int32_t u=0; u<width;  u+=D_candidate_stepsize) D_can_width++;
 	for (int32_t v=0; v<height; v+=D_candidate_stepsize) D_can_height++;
-	int16_t* D_can = (int16_t*)calloc(D_can_width*D_can_height,sizeof(int16_t));
+	memset(D_can,0,D_can_width*D_can_height*sizeof(int16_t));
 
 	// loop variables
 	int32_t u,v;
 	int16_t d,d2;
 	int32_t u_can, v_can;
 	int32_t lr_threshold = param.lr_threshold;
-	vector<support_pt> p_support;
-	vector<support_pt> partial_p_support[2];
+	int32_t num_threads  = getNumThreads();
+	bool    temporal     = temporal_valid;
+	int32_t refresh      = max(param.temporal_refresh,1);
+	int32_t frame        = temporal_frame+1;
+	vector< vector<support_pt> > &partial_p_support = support_partial;
+	partial_p_support.resize(num_threads);
+	for (int32_t i=0; i<num_threads; i++)
+		partial_p_support[i].clear();
 	// for all point candidates in image 1 do
-	#pragma omp parallel default(none) num_threads(2) private(u_can, v_can, u, d, v, d2) shared(partial_p_support,lr_threshold, D_can, D_can_width, D_can_height, D_candidate_stepsize, I1_desc, I2_desc)
+	#pragma omp parallel default(none) num_threads(num_threads) private(u_can, v_can, u, d, v, d2) shared(partial_p_support,lr_threshold, D_can, D_can_width, D_can_height, D_candidate_stepsize, I1_desc, I2_desc, temporal, refresh, frame)
 	{
 		int tid = omp_get_thread_num();
-	#pragma omp for
+		int64_t num_sad = 0;
+		int32_t num_reused = 0;
+	#pragma omp for schedule(dynamic)
 	for (v_can=1; v_can<D_can_height; v_can++) {
 		v = v_can*D_candidate_stepsize;
 		for (u_can=1; u_can<D_can_width; u_can++) {
 			u = u_can*D_candidate_stepsize;
+			int32_t addr = getAddressOffsetImage(u_can,v_can,D_can_width);
 
 			// initialize disparity candidate to invalid
-			*(D_can+getAddressOffsetImage(u_can,v_can,D_can_width)) = -1;
+			D_can[addr] = -1;
+
+			// video streams: verify the match of the previous frame in a narrow window,
+			// candidates without a match are only searched again in their refresh frame
+			if (temporal) {
+				if (D_can_prev[addr]>=0) {
+					int32_t radius = param.temporal_radius;
+					d = computeMatchingDisparity(u,v,I1_desc,I2_desc,false,num_sad,D_can_prev[addr]-radius,D_can_prev[addr]+radius);
+					if (d>=0) {
+						d2 = computeMatchingDisparity(u-d,v,I1_desc,I2_desc,true,num_sad,d-radius,d+radius);
+						if (d2>=0 && abs(d-d2)<=lr_threshold) {
+							D_can[addr] = D_can_prev[addr] = d;
+							num_reused++;
+							continue;
+						}
+					}
+				} else if ((u_can+v_can+frame)%refresh!=0) {
+					continue;
+				}
+			}
 
 			// find forwards
-			d = computeMatchingDisparity(u,v,I1_desc,I2_desc,false);
+			d = computeMatchingDisparity(u,v,I1_desc,I2_desc,false,num_sad);
 			if (d>=0) {
 
 				// find backwards
-				d2 = computeMatchingDisparity(u-d,v,I1_desc,I2_desc,true);
+				// (the right image cost of u-d at disparity d' equals the left image
+				//  cost of u-d+d' at d', but the forward searches only cover every
+				//  candidate_stepsize-th column, hence at most 2 of 5 descriptor
+				//  SADs could be taken from them; a dense row of costs would cost
+				//  more than both searches together)
+				d2 = computeMatchingDisparity(u-d,v,I1_desc,I2_desc,true,num_sad);
 				if (d2>=0 && abs(d-d2)<=lr_threshold)
-					*(D_can+getAddressOffsetImage(u_can,v_can,D_can_width)) = d;
+					D_can[addr] = d;
 			}
+			D_can_prev[addr] = D_can[addr];
 		}
 	}
+	#pragma omp atomic
+	stat.num_sad_evaluations += num_sad;
+	#pragma omp atomic
+	stat.num_support_reused += num_reused;
 
 
 
 	// remove inconsistent support points
+	// (the removal is done in place and depends on the visiting order,
+	//  hence it runs on a single thread to be independent of num_threads)
 	//timer.start("removeInconsistentSupportPoints");
+	#pragma omp single
+	{
 	removeInconsistentSupportPoints(D_can,D_can_width,D_can_height);
 
 	// remove support points on straight lines, since they are redundant
@@ -441,6 +676,7 @@ vector<Elas::support_pt> Elas::computeSupportMatches (uint8_t* I1_desc,uint8_t*
 	//timer.start("removeRedundantSupportPoints");
 	removeRedundantSupportPoints(D_can,D_can_width,D_can_height,5,1,true);
 	removeRedundantSupportPoints(D_can,D_can_width,D_can_height,5,1,false);
+	}
 
 	//}
 	// move support points from image representation into a vector representation
@@ -448,7 +684,8 @@ vector<Elas::support_pt> Elas::computeSupportMatches (uint8_t* I1_desc,uint8_t*
 
 
 
-	#pragma omp for
+	// (static schedule: concatenating the partial lists preserves the row order)
+	#pragma omp for schedule(static)
 	for (int32_t v_can=1; v_can<D_can_height; v_can++)
 		for (int32_t u_can=1; u_can<D_can_width; u_can++)
 			if (*(D_can+getAddressOffsetImage(u_can,v_can,D_can_width))>=0)
@@ -456,43 +693,75 @@ vector<Elas::support_pt> Elas::computeSupportMatches (uint8_t* I1_desc,uint8_t*
 						v_can*D_candidate_stepsize,
 						*(D_can+getAddressOffsetImage(u_can,v_can,D_can_width))));
 	}
-	p_support = partial_p_support[0];
-	p_support.insert(p_support.end(),partial_p_support[1].begin(),partial_p_support[1].end());
+	size_t num_support = 0;
+	for (int32_t i=0; i<num_threads; i++)
+		num_support += partial_p_support[i].size();
+	p_support.clear();
+	p_support.reserve(num_support+6);
+	for (int32_t i=0; i<num_threads; i++)
+		p_support.insert(p_support.end(),partial_p_support[i].begin(),partial_p_support[i].end());
 
 	// if flag is set, add support points in image corners
 	// with the same disparity as the nearest neighbor support point
 	if (param.add_corners)
 		addCornerSupportPoints(p_support);
+}
 
+void Elas::computeDelaunayTriangulation (const vector<support_pt> &p_support,vector<triangle> &tri,int32_t right_image) {
 
-	// free memory
-	free(D_can);
+	// support point coordinates in the left / right image, compared to the
+	// previous frame (temporal_support) whose triangulation is kept if none of
+	// them changed. otherwise the integer triangulation updates the previous one
+	// if at most every 8th point changed, Triangle always triangulates again
+	vector<int32_t> &points = tri_points[right_image];
+	bool unchanged = temporal_valid && points.size()==p_support.size()*2;
+	points.resize(p_support.size()*2);
+	for (int32_t i=0; i<p_support.size(); i++) {
+		int32_t u = right_image ? p_support[i].u-p_support[i].d : p_support[i].u;
+		unchanged = unchanged && points[2*i]==u && points[2*i+1]==p_support[i].v;
+		points[2*i]   = u;
+		points[2*i+1] = p_support[i].v;
+	}
+
+	// exact integer triangulation, exploits that support points lie on the candidate grid,
+	// Triangle is used if it is disabled or the coordinate range is too large
+	// (less than 3 support points, e.g. on tiny images, give no triangles)
+	vector<int32_t> &corners = tri_corners[right_image];
+	if (p_support.size()<3) {
+		corners.clear();
+	} else if (unchanged) {
+		#pragma omp atomic
+		stat.num_triangulations_reused++;
+	} else if (param.fast_triangulation) {
+		bool incremental = false;
+		bool ok = temporal_valid ?
+		          tri_fast[right_image].update(points.data(),p_support.size(),corners,p_support.size()/8,incremental) :
+		          tri_fast[right_image].triangulate(points.data(),p_support.size(),corners);
+		if (!ok)
+			triangulateGeneral(points,corners,right_image);
+		if (incremental) {
+			#pragma omp atomic
+			stat.num_triangulations_updated++;
+		}
+	} else {
+		triangulateGeneral(points,corners,right_image);
+	}
 
-	// return support point vector
-	return p_support;
+	// put resulting triangles into vector tri
+	tri.clear();
+	tri.reserve(corners.size()/3);
+	for (int32_t k=0; k<corners.size(); k+=3)
+		tri.push_back(triangle(corners[k],corners[k+1],corners[k+2]));
 }
 
-vector<Elas::triangle> Elas::computeDelaunayTriangulation (vector<support_pt> p_support,int32_t right_image) {
+void Elas::triangulateGeneral (const vector<int32_t> &points,vector<int32_t> &corners,int32_t right_image) {
 
 	// input/output structure for triangulation
 	struct triangulateio in, out;
-	int32_t k;
-
-	// inputs
-	in.numberofpoints = p_support.size();
-	in.pointlist = (float*)malloc(in.numberofpoints*2*sizeof(float));
-	k=0;
-	if (!right_image) {
-		for (int32_t i=0; i<p_support.size(); i++) {
-			in.pointlist[k++] = p_support[i].u;
-			in.pointlist[k++] = p_support[i].v;
-		}
-	} else {
-		for (int32_t i=0; i<p_support.size(); i++) {
-			in.pointlist[k++] = p_support[i].u-p_support[i].d;
-			in.pointlist[k++] = p_support[i].v;
-		}
-	}
+	vector<float> &pointlist = tri_pointlist[right_image];
+	pointlist.assign(points.begin(),points.end());
+	in.numberofpoints          = points.size()/2;
+	in.pointlist               = pointlist.data();
 	in.numberofpointattributes = 0;
 	in.pointattributelist      = NULL;
 	in.pointmarkerlist         = NULL;
@@ -501,11 +770,13 @@ vector<Elas::triangle> Elas::computeDelaunayTriangulation (vector<support_pt> p_
 	in.numberofregions         = 0;
 	in.regionlist              = NULL;
 
-	// outputs
+	// outputs (the triangle corners are written to corners directly,
+	// n points give less than 2n triangles)
+	corners.resize(6*in.numberofpoints);
 	out.pointlist              = NULL;
 	out.pointattributelist     = NULL;
 	out.pointmarkerlist        = NULL;
-	out.trianglelist           = NULL;
+	out.trianglelist           = corners.data();
 	out.triangleattributelist  = NULL;
 	out.neighborlist           = NULL;
 	out.segmentlist            = NULL;
@@ -513,108 +784,102 @@ vector<Elas::triangle> Elas::computeDelaunayTriangulation (vector<support_pt> p_
 	out.edgelist               = NULL;
 	out.edgemarkerlist         = NULL;
 
-	// do triangulation (z=zero-based, n=neighbors, Q=quiet, B=no boundary markers)
-	char parameters[] = "zQB";
-	triangulate(parameters, &in, &out, NULL);
-
-	// put resulting triangles into vector tri
-	vector<triangle> tri;
-	k=0;
-	for (int32_t i=0; i<out.numberoftriangles; i++) {
-		tri.push_back(triangle(out.trianglelist[k],out.trianglelist[k+1],out.trianglelist[k+2]));
-		k+=3;
-	}
+	// do triangulation (z=zero-based, Q=quiet, B=no boundary markers, N=no output points)
+	char parameters[] = "zQBN";
+	triangulate(parameters, &in, &out, NULL, tri_engine[right_image]);
 
-	// free memory used for triangulation
-	free(in.pointlist);
-	free(out.pointlist);
-	free(out.trianglelist);
-
-	// return triangles
-	return tri;
+	corners.resize(3*out.numberoftriangles);
 }
 
-void Elas::computeDisparityPlanes (vector<support_pt> p_support,vector<triangle> &tri,int32_t right_image) {
-
-	// init matrices
-	Matrix A(3,3);
-	Matrix b(3,1);
-
-	// for all triangles do
-	for (int32_t i=0; i<tri.size(); i++) {
-
-		// get triangle corner indices
-		int32_t c1 = tri[i].c1;
-		int32_t c2 = tri[i].c2;
-		int32_t c3 = tri[i].c3;
-
-		// compute matrix A for linear system of left triangle
-		A.val[0][0] = p_support[c1].u;
-		A.val[1][0] = p_support[c2].u;
-		A.val[2][0] = p_support[c3].u;
-		A.val[0][1] = p_support[c1].v; A.val[0][2] = 1;
-		A.val[1][1] = p_support[c2].v; A.val[1][2] = 1;
-		A.val[2][1] = p_support[c3].v; A.val[2][2] = 1;
-
-		// compute vector b for linear system (containing the disparities)
-		b.val[0][0] = p_support[c1].d;
-		b.val[1][0] = p_support[c2].d;
-		b.val[2][0] = p_support[c3].d;
-
-		// on success of gauss jordan elimination
-		if (b.solve(A)) {
-
-			// grab results from b
-			tri[i].t1a = b.val[0][0];
-			tri[i].t1b = b.val[1][0];
-			tri[i].t1c = b.val[2][0];
-
-			// otherwise: invalid
-		} else {
-			tri[i].t1a = 0;
-			tri[i].t1b = 0;
-			tri[i].t1c = 0;
+inline void Elas::solvePlanes (const __m128* u,const __m128* v,const __m128* d,__m128 &a,__m128 &b,__m128 &c) {
+
+	// corners relative to the first one
+	__m128 du2 = _mm_sub_ps(u[1],u[0]), du3 = _mm_sub_ps(u[2],u[0]);
+	__m128 dv2 = _mm_sub_ps(v[1],v[0]), dv3 = _mm_sub_ps(v[2],v[0]);
+	__m128 dd2 = _mm_sub_ps(d[1],d[0]), dd3 = _mm_sub_ps(d[2],d[0]);
+
+	// Cramer's rule (degenerate triangles get a zero plane)
+	__m128 det   = _mm_sub_ps(_mm_mul_ps(du2,dv3),_mm_mul_ps(du3,dv2));
+	__m128 num_a = _mm_sub_ps(_mm_mul_ps(dd2,dv3),_mm_mul_ps(dd3,dv2));
+	__m128 num_b = _mm_sub_ps(_mm_mul_ps(du2,dd3),_mm_mul_ps(du3,dd2));
+	__m128 valid = _mm_cmpneq_ps(det,_mm_set1_ps(0));
+	a = _mm_and_ps(valid,_mm_div_ps(num_a,det));
+	b = _mm_and_ps(valid,_mm_div_ps(num_b,det));
+
+	// c = (d1*det-num_a*u1-num_b*v1)/det: the numerator exceeds the float
+	// mantissa, but is exact in double (two lanes per register)
+	__m128 xc[2];
+	for (int32_t h=0; h<2; h++) {
+		__m128 shift[5] = {det,num_a,num_b,u[0],d[0]};
+		__m128 v1 = v[0];
+		if (h) {
+			for (int32_t k=0; k<5; k++)
+				shift[k] = _mm_movehl_ps(shift[k],shift[k]);
+			v1 = _mm_movehl_ps(v1,v1);
 		}
+		__m128d det_h = _mm_cvtps_pd(shift[0]);
+		__m128d num_c = _mm_mul_pd(_mm_cvtps_pd(shift[4]),det_h);
+		num_c = _mm_sub_pd(num_c,_mm_mul_pd(_mm_cvtps_pd(shift[1]),_mm_cvtps_pd(shift[3])));
+		num_c = _mm_sub_pd(num_c,_mm_mul_pd(_mm_cvtps_pd(shift[2]),_mm_cvtps_pd(v1)));
+		xc[h] = _mm_cvtpd_ps(_mm_div_pd(num_c,det_h));
+	}
+	c = _mm_and_ps(valid,_mm_movelh_ps(xc[0],xc[1]));
+}
 
-		// compute matrix A for linear system of right triangle
-		A.val[0][0] = p_support[c1].u-p_support[c1].d;
-		A.val[1][0] = p_support[c2].u-p_support[c2].d;
-		A.val[2][0] = p_support[c3].u-p_support[c3].d;
-		A.val[0][1] = p_support[c1].v; A.val[0][2] = 1;
-		A.val[1][1] = p_support[c2].v; A.val[1][2] = 1;
-		A.val[2][1] = p_support[c3].v; A.val[2][2] = 1;
-
-		// compute vector b for linear system (containing the disparities)
-		b.val[0][0] = p_support[c1].d;
-		b.val[1][0] = p_support[c2].d;
-		b.val[2][0] = p_support[c3].d;
-
-		// on success of gauss jordan elimination
-		if (b.solve(A)) {
-
-			// grab results from b
-			tri[i].t2a = b.val[0][0];
-			tri[i].t2b = b.val[1][0];
-			tri[i].t2c = b.val[2][0];
+void Elas::computeDisparityPlanes (const vector<support_pt> &p_support,vector<triangle> &tri,int32_t right_image) {
+
+	// the planes d = a*u+b*v+c through the corners of each triangle in the left
+	// image (t1) and in the right image (t2, u-d) are solved in closed form.
+	// corner coordinates are integers, hence the determinant and the numerators
+	// of a and b are exact as long as their products stay below 2^24 (images of
+	// up to about 4000x4000 pixels). triangles are processed in batches of 4,
+	// gathered into one SSE lane each
+	int32_t num_tri     = tri.size();
+	int32_t num_batches = (num_tri+3)/4;
+	#pragma omp parallel for num_threads(getNumThreads())
+	for (int32_t i=0; i<num_batches; i++) {
+
+		// gather corners (the last batch repeats its last triangle)
+		__m128 xu[3],xu_r[3],xv[3],xd[3];
+		float *u = (float*)xu,*u_r = (float*)xu_r,*v = (float*)xv,*d = (float*)xd;
+		for (int32_t l=0; l<4; l++) {
+			const triangle &t = tri[min(4*i+l,num_tri-1)];
+			int32_t c[3] = {t.c1,t.c2,t.c3};
+			for (int32_t k=0; k<3; k++) {
+				const support_pt &p = p_support[c[k]];
+				u[4*k+l]   = p.u;
+				u_r[4*k+l] = p.u-p.d;
+				v[4*k+l]   = p.v;
+				d[4*k+l]   = p.d;
+			}
+		}
 
-			// otherwise: invalid
-		} else {
-			tri[i].t2a = 0;
-			tri[i].t2b = 0;
-			tri[i].t2c = 0;
+		// solve left and right planes
+		__m128 xplane[6];
+		solvePlanes(xu,xv,xd,xplane[0],xplane[1],xplane[2]);
+		solvePlanes(xu_r,xv,xd,xplane[3],xplane[4],xplane[5]);
+
+		// scatter results
+		float *plane = (float*)xplane;
+		for (int32_t l=0; l<4 && 4*i+l<num_tri; l++) {
+			triangle &t = tri[4*i+l];
+			t.t1a = plane[0*4+l]; t.t1b = plane[1*4+l]; t.t1c = plane[2*4+l];
+			t.t2a = plane[3*4+l]; t.t2b = plane[4*4+l]; t.t2c = plane[5*4+l];
 		}
 	}
 }
 
-void Elas::createGrid(vector<support_pt> p_support,int32_t* disparity_grid,int32_t* grid_dims,bool right_image) {
+void Elas::createGrid(const vector<support_pt> &p_support,grid_lists &disparity_grid,int32_t* grid_dims,bool right_image) {
 
 	// get grid dimensions
 	int32_t grid_width  = grid_dims[1];
 	int32_t grid_height = grid_dims[2];
+	int32_t grid_words  = getGridWords();
+	int32_t grid_size   = grid_width*grid_height*grid_words;
 
-	// allocate temporary memory
-	int32_t* temp1 = (int32_t*)calloc((param.disp_max+1)*grid_height*grid_width,sizeof(int32_t));
-	int32_t* temp2 = (int32_t*)calloc((param.disp_max+1)*grid_height*grid_width,sizeof(int32_t));
+	// temporary bitsets, bit d%64 of word d/64 of a cell marks disparity d
+	uint64_t* temp = grid_temp[right_image];
+	memset(temp,0,grid_size*sizeof(uint64_t));
 
 	// for all support points do
 	for (int32_t i=0; i<p_support.size(); i++) {
@@ -637,82 +902,68 @@ void Elas::createGrid(vector<support_pt> p_support,int32_t* disparity_grid,int32
 
 			// point may potentially lay outside (corner points)
 			if (x>=0 && x<grid_width &&y>=0 && y<grid_height) {
-				int32_t addr = getAddressOffsetGrid(x,y,d,grid_width,param.disp_max+1);
-				*(temp1+addr) = 1;
+				int32_t addr = getAddressOffsetGrid(x,y,d/64,grid_width,grid_words);
+				*(temp+addr) |= (uint64_t)1<<(d%64);
 			}
 		}
 	}
 
-	// diffusion pointers
-	const int32_t* tl = temp1 + (0*grid_width+0)*(param.disp_max+1);
-	const int32_t* tc = temp1 + (0*grid_width+1)*(param.disp_max+1);
-	const int32_t* tr = temp1 + (0*grid_width+2)*(param.disp_max+1);
-	const int32_t* cl = temp1 + (1*grid_width+0)*(param.disp_max+1);
-	const int32_t* cc = temp1 + (1*grid_width+1)*(param.disp_max+1);
-	const int32_t* cr = temp1 + (1*grid_width+2)*(param.disp_max+1);
-	const int32_t* bl = temp1 + (2*grid_width+0)*(param.disp_max+1);
-	const int32_t* bc = temp1 + (2*grid_width+1)*(param.disp_max+1);
-	const int32_t* br = temp1 + (2*grid_width+2)*(param.disp_max+1);
-
-	int32_t* result    = temp2 + (1*grid_width+1)*(param.disp_max+1);
-	int32_t* end_input = temp1 + grid_width*grid_height*(param.disp_max+1);
-
-	// diffuse temporary grid
-	for( ; br != end_input; tl++, tc++, tr++, cl++, cc++, cr++, bl++, bc++, br++, result++ )
-		*result = *tl | *tc | *tr | *cl | *cc | *cr | *bl | *bc | *br;
-
-	// for all grid positions create disparity grid
-	for (int32_t x=0; x<grid_width; x++) {
-		for (int32_t y=0; y<grid_height; y++) {
-
-			// start with second value (first is reserved for count)
-			int32_t curr_ind = 1;
-
-			// for all disparities do
-			for (int32_t d=0; d<=param.disp_max; d++) {
-
-				// if yes => add this disparity to current cell
-				if (*(temp2+getAddressOffsetGrid(x,y,d,grid_width,param.disp_max+1))>0) {
-					*(disparity_grid+getAddressOffsetGrid(x,y,curr_ind,grid_width,param.disp_max+2))=d;
-					curr_ind++;
+	// diffusion: a cell holds the union of its 3x3 neighborhood in temp, the
+	// cells are traversed as one flat array (the first and last grid_width+1
+	// cells stay empty). the first pass counts the disparities of each cell,
+	// the second one writes them into the packed lists
+	const int32_t o[9] = {0,grid_words,2*grid_words,
+	                      grid_width*grid_words,(grid_width+1)*grid_words,(grid_width+2)*grid_words,
+	                      2*grid_width*grid_words,(2*grid_width+1)*grid_words,(2*grid_width+2)*grid_words};
+	int32_t num_cells  = grid_width*grid_height;
+	int32_t cell_begin = grid_width+1;
+	int32_t cell_end   = max(num_cells-grid_width-1,cell_begin);
+	vector<int32_t>  &offset = disparity_grid.offset;
+	vector<uint16_t> &list   = disparity_grid.disp;
+	offset.resize(num_cells+1);
+	for (int32_t pass=0; pass<2; pass++) {
+		offset[0] = 0;
+		for (int32_t c=0; c<num_cells; c++) {
+			int32_t curr_ind = offset[c];
+			if (c>=cell_begin && c<cell_end) {
+				const uint64_t* bits = temp+(c-cell_begin)*grid_words;
+				for (int32_t w=0; w<grid_words; w++) {
+					uint64_t word = bits[w+o[0]] | bits[w+o[1]] | bits[w+o[2]] | bits[w+o[3]] | bits[w+o[4]] |
+					                bits[w+o[5]] | bits[w+o[6]] | bits[w+o[7]] | bits[w+o[8]];
+					if (pass==0) {
+						curr_ind += __builtin_popcountll(word);
+					} else {
+						// add the set bits in ascending order
+						for (; word!=0; word&=word-1)
+							list[curr_ind++] = 64*w+__builtin_ctzll(word);
+					}
 				}
 			}
-
-			// finally set number of indices
-			*(disparity_grid+getAddressOffsetGrid(x,y,0,grid_width,param.disp_max+2))=curr_ind-1;
+			offset[c+1] = curr_ind;
 		}
+		if (pass==0)
+			list.resize(offset[num_cells]);
 	}
-
-	// release temporary memory
-	free(temp1);
-	free(temp2);
 }
 
-inline void Elas::updatePosteriorMinimum(__m128i* I2_block_addr,const int32_t &d,const int32_t &w,
-		const __m128i &xmm1,__m128i &xmm2,int32_t &val,int32_t &min_val,int32_t &min_d) {
-	xmm2 = _mm_load_si128(I2_block_addr);
-	xmm2 = _mm_sad_epu8(xmm1,xmm2);
-	val  = _mm_extract_epi16(xmm2,0)+_mm_extract_epi16(xmm2,4)+w;
-	if (val<min_val) {
-		min_val = val;
-		min_d   = d;
-	}
-}
-
-inline void Elas::updatePosteriorMinimum(__m128i* I2_block_addr,const int32_t &d,
-		const __m128i &xmm1,__m128i &xmm2,int32_t &val,int32_t &min_val,int32_t &min_d) {
-	xmm2 = _mm_load_si128(I2_block_addr);
-	xmm2 = _mm_sad_epu8(xmm1,xmm2);
-	val  = _mm_extract_epi16(xmm2,0)+_mm_extract_epi16(xmm2,4);
-	if (val<min_val) {
-		min_val = val;
-		min_d   = d;
+inline void Elas::updatePosteriorMinimum(uint8_t* I1_block_addr,const match_candidates &cand,int32_t n,
+		int32_t &min_val,int32_t &min_d,int64_t &num_sad) {
+	int32_t cost[findmatch_chunk];
+	matching::sadList(I1_block_addr,cand.I2_block_addr,n,cost);
+	num_sad += n;
+	for (int32_t k=0; k<n; k++) {
+		int32_t val = cost[k]+cand.w[k];
+		if (val<min_val) {
+			min_val = val;
+			min_d   = cand.d[k];
+		}
 	}
 }
 
 inline void Elas::findMatch(int32_t &u,int32_t &v,float &plane_a,float &plane_b,float &plane_c,
-		int32_t* disparity_grid,int32_t *grid_dims,uint8_t* I1_desc,uint8_t* I2_desc,
-		int32_t *P,int32_t &plane_radius,bool &valid,bool &right_image,float* D){
+		const grid_lists &disparity_grid,int32_t *grid_dims,uint8_t* I1_desc,uint8_t* I2_desc,
+		int32_t *P,int32_t &plane_radius,bool &valid,bool &right_image,float* D,const float* D_prev,
+		match_candidates &cand,int64_t &num_sad,int32_t &num_prior){
 
 	// get image width and height
 	const int32_t disp_num    = grid_dims[0]-1;
@@ -756,53 +1007,83 @@ inline void Elas::findMatch(int32_t &u,int32_t &v,float &plane_a,float &plane_b,
 	// get grid pointer
 	int32_t  grid_x    = (int32_t)floor((float)u/(float)param.grid_size);
 	int32_t  grid_y    = (int32_t)floor((float)v/(float)param.grid_size);
-	uint32_t grid_addr = getAddressOffsetGrid(grid_x,grid_y,0,grid_dims[1],grid_dims[0]);
-	int32_t  num_grid  = *(disparity_grid+grid_addr);
-	int32_t* d_grid    = disparity_grid+grid_addr+1;
+	uint32_t grid_addr = getAddressOffsetGridCell(grid_x,grid_y,grid_dims[1]);
+	int32_t   num_grid = disparity_grid.offset[grid_addr+1]-disparity_grid.offset[grid_addr];
+	const uint16_t* d_grid = disparity_grid.disp.data()+disparity_grid.offset[grid_addr];
 
 	// loop variables
-	int32_t d_curr, u_warp, val;
+	int32_t d_curr, u_warp;
 	int32_t min_val = 10000;
 	int32_t min_d   = -1;
-	__m128i xmm1    = _mm_load_si128((__m128i*)I1_block_addr);
-	__m128i xmm2;
 
-	// left image
-	if (!right_image) {
-		for (int32_t i=0; i<num_grid; i++) {
-			d_curr = d_grid[i];
-			if (d_curr<d_plane_min || d_curr>d_plane_max) {
-				u_warp = u-d_curr;
-				if (u_warp<window_size || u_warp>=width-window_size)
-					continue;
-				updatePosteriorMinimum((__m128i*)(I2_line_addr+16*u_warp),d_curr,xmm1,xmm2,val,min_val,min_d);
-			}
-		}
-		for (d_curr=d_plane_min; d_curr<=d_plane_max; d_curr++) {
-			u_warp = u-d_curr;
+	// warp direction (left image: u-d, right image: u+d)
+	int32_t u_dir = right_image ? +1 : -1;
+
+	// candidates are collected in cand and evaluated in chunks by the SAD
+	// kernel, in the same order as they are visited
+	int32_t n_cand = 0;
+
+	// temporal prior: search a band around the previous disparity first and
+	// accept its minimum if it is cheap and not on a (clipped) band border
+	if (D_prev!=0 && *(D_prev+d_addr)>=0) {
+		int32_t d_prev     = (int32_t)(*(D_prev+d_addr)+0.5f);
+		int32_t d_band_min = max(d_prev-param.prior_radius,0);
+		int32_t d_band_max = min(d_prev+param.prior_radius,disp_num-1);
+		for (d_curr=d_band_min; d_curr<=d_band_max; d_curr++) {
+			u_warp = u+u_dir*d_curr;
 			if (u_warp<window_size || u_warp>=width-window_size)
 				continue;
-			updatePosteriorMinimum((__m128i*)(I2_line_addr+16*u_warp),d_curr,valid?*(P+abs(d_curr-d_plane)):0,xmm1,xmm2,val,min_val,min_d);
-		}
-
-		// right image
-	} else {
-		for (int32_t i=0; i<num_grid; i++) {
-			d_curr = d_grid[i];
-			if (d_curr<d_plane_min || d_curr>d_plane_max) {
-				u_warp = u+d_curr;
-				if (u_warp<window_size || u_warp>=width-window_size)
-					continue;
-				updatePosteriorMinimum((__m128i*)(I2_line_addr+16*u_warp),d_curr,xmm1,xmm2,val,min_val,min_d);
+			cand.I2_block_addr[n_cand] = I2_line_addr+16*u_warp;
+			cand.d[n_cand]        = d_curr;
+			cand.w[n_cand]        = valid && d_curr>=d_plane_min && d_curr<=d_plane_max ? *(P+abs(d_curr-d_plane)) : 0;
+			if (++n_cand==findmatch_chunk) {
+				updatePosteriorMinimum(I1_block_addr,cand,n_cand,min_val,min_d,num_sad);
+				n_cand = 0;
 			}
 		}
-		for (d_curr=d_plane_min; d_curr<=d_plane_max; d_curr++) {
-			u_warp = u+d_curr;
+		updatePosteriorMinimum(I1_block_addr,cand,n_cand,min_val,min_d,num_sad);
+		n_cand = 0;
+		if (min_d>=0 && min_val<=param.prior_max_cost &&
+				(min_d>d_band_min || d_band_min==0) && (min_d<d_band_max || d_band_max==disp_num-1)) {
+			*(D+d_addr) = min_d;
+			num_prior++;
+			return;
+		}
+		min_val = 10000;
+		min_d   = -1;
+	}
+
+	// grid disparities outside the plane prior (no prior weight)
+	for (int32_t i=0; i<num_grid; i++) {
+		d_curr = d_grid[i];
+		if (d_curr<d_plane_min || d_curr>d_plane_max) {
+			u_warp = u+u_dir*d_curr;
 			if (u_warp<window_size || u_warp>=width-window_size)
 				continue;
-			updatePosteriorMinimum((__m128i*)(I2_line_addr+16*u_warp),d_curr,valid?*(P+abs(d_curr-d_plane)):0,xmm1,xmm2,val,min_val,min_d);
+			cand.I2_block_addr[n_cand] = I2_line_addr+16*u_warp;
+			cand.d[n_cand]        = d_curr;
+			cand.w[n_cand]        = 0;
+			if (++n_cand==findmatch_chunk) {
+				updatePosteriorMinimum(I1_block_addr,cand,n_cand,min_val,min_d,num_sad);
+				n_cand = 0;
+			}
+		}
+	}
+
+	// disparities close to the plane prior
+	for (d_curr=d_plane_min; d_curr<=d_plane_max; d_curr++) {
+		u_warp = u+u_dir*d_curr;
+		if (u_warp<window_size || u_warp>=width-window_size)
+			continue;
+		cand.I2_block_addr[n_cand] = I2_line_addr+16*u_warp;
+		cand.d[n_cand]        = d_curr;
+		cand.w[n_cand]        = valid?*(P+abs(d_curr-d_plane)):0;
+		if (++n_cand==findmatch_chunk) {
+			updatePosteriorMinimum(I1_block_addr,cand,n_cand,min_val,min_d,num_sad);
+			n_cand = 0;
 		}
 	}
+	updatePosteriorMinimum(I1_block_addr,cand,n_cand,min_val,min_d,num_sad);
 
 	// set disparity value
 	if (min_d>=0) *(D+d_addr) = min_d; // MAP value (min neg-Log probability)
@@ -810,15 +1091,102 @@ inline void Elas::findMatch(int32_t &u,int32_t &v,float &plane_a,float &plane_b,
 }
 
 // TODO: %2 => more elegantly
-void Elas::computeDisparity(vector<support_pt> p_support,vector<triangle> tri,int32_t* disparity_grid,int32_t *grid_dims,
-		uint8_t* I1_desc,uint8_t* I2_desc,bool right_image,float* D) {
+inline void Elas::computeDisparityTriangle(const vector<support_pt> &p_support,const triangle &tri,int32_t u_begin,int32_t u_end,
+		const grid_lists &disparity_grid,int32_t *grid_dims,uint8_t* I1_desc,uint8_t* I2_desc,int32_t plane_radius,bool right_image,float* D,
+		const float* D_prev,match_candidates &cand,int64_t &num_sad,int32_t &num_prior) {
+
+	// get plane parameters
+	float plane_a,plane_b,plane_c,plane_d;
+	if (!right_image) {
+		plane_a = tri.t1a;
+		plane_b = tri.t1b;
+		plane_c = tri.t1c;
+		plane_d = tri.t2a;
+	} else {
+		plane_a = tri.t2a;
+		plane_b = tri.t2b;
+		plane_c = tri.t2c;
+		plane_d = tri.t1a;
+	}
+
+	// triangle corners
+	int32_t c1 = tri.c1;
+	int32_t c2 = tri.c2;
+	int32_t c3 = tri.c3;
 
-	// number of disparities
-	//const int32_t disp_num  = grid_dims[0]-1;
-	int disp_num = grid_dims[0]-1;
+	// sort triangle corners wrt. u (ascending)
+	float tri_u[3];
+	if (!right_image) {
+		tri_u[0] = p_support[c1].u;
+		tri_u[1] = p_support[c2].u;
+		tri_u[2] = p_support[c3].u;
+	} else {
+		tri_u[0] = p_support[c1].u-p_support[c1].d;
+		tri_u[1] = p_support[c2].u-p_support[c2].d;
+		tri_u[2] = p_support[c3].u-p_support[c3].d;
+	}
+	float tri_v[3] = {(float)p_support[c1].v,(float)p_support[c2].v,(float)p_support[c3].v};
+
+	for (uint32_t j=0; j<3; j++) {
+		for (uint32_t k=0; k<j; k++) {
+			if (tri_u[k]>tri_u[j]) {
+				float tri_u_temp = tri_u[j]; tri_u[j] = tri_u[k]; tri_u[k] = tri_u_temp;
+				float tri_v_temp = tri_v[j]; tri_v[j] = tri_v[k]; tri_v[k] = tri_v_temp;
+			}
+		}
+	}
 
-	// descriptor window_size
-	int32_t window_size = 2;
+	// rename corners
+	float A_u = tri_u[0]; float A_v = tri_v[0];
+	float B_u = tri_u[1]; float B_v = tri_v[1];
+	float C_u = tri_u[2]; float C_v = tri_v[2];
+
+	// compute straight lines connecting triangle corners
+	float AB_a = 0; float AC_a = 0; float BC_a = 0;
+	if ((int32_t)(A_u)!=(int32_t)(B_u)) AB_a = (A_v-B_v)/(A_u-B_u);
+	if ((int32_t)(A_u)!=(int32_t)(C_u)) AC_a = (A_v-C_v)/(A_u-C_u);
+	if ((int32_t)(B_u)!=(int32_t)(C_u)) BC_a = (B_v-C_v)/(B_u-C_u);
+	float AB_b = A_v-AB_a*A_u;
+	float AC_b = A_v-AC_a*A_u;
+	float BC_b = B_v-BC_a*B_u;
+
+	// a plane is only valid if itself and its projection
+	// into the other image is not too much slanted
+	bool valid = fabs(plane_a)<0.7 && fabs(plane_d)<0.7;
+
+	// first part (triangle corner A->B)
+	if ((int32_t)(A_u)!=(int32_t)(B_u)) {
+		for (int32_t u=max((int32_t)A_u,u_begin); u<min((int32_t)B_u,u_end); u++){
+			if (!param.subsampling || u%2==0) {
+				int32_t v_1 = (uint32_t)(AC_a*(float)u+AC_b);
+				int32_t v_2 = (uint32_t)(AB_a*(float)u+AB_b);
+				for (int32_t v=min(v_1,v_2); v<max(v_1,v_2); v++)
+					if (!param.subsampling || v%2==0) {
+						findMatch(u,v,plane_a,plane_b,plane_c,disparity_grid,grid_dims,
+								I1_desc,I2_desc,P,plane_radius,valid,right_image,D,D_prev,cand,num_sad,num_prior);
+					}
+			}
+		}
+	}
+
+	// second part (triangle corner B->C)
+	if ((int32_t)(B_u)!=(int32_t)(C_u)) {
+		for (int32_t u=max((int32_t)B_u,u_begin); u<min((int32_t)C_u,u_end); u++){
+			if (!param.subsampling || u%2==0) {
+				int32_t v_1 = (uint32_t)(AC_a*(float)u+AC_b);
+				int32_t v_2 = (uint32_t)(BC_a*(float)u+BC_b);
+				for (int32_t v=min(v_1,v_2); v<max(v_1,v_2); v++)
+					if (!param.subsampling || v%2==0) {
+						findMatch(u,v,plane_a,plane_b,plane_c,disparity_grid,grid_dims,
+								I1_desc,I2_desc,P,plane_radius,valid,right_image,D,D_prev,cand,num_sad,num_prior);
+					}
+			}
+		}
+	}
+}
+
+void Elas::computeDisparity(const vector<support_pt> &p_support,const vector<triangle> &tri,const grid_lists &disparity_grid,int32_t *grid_dims,
+		uint8_t* I1_desc,uint8_t* I2_desc,bool right_image,float* D,const float* D_prev) {
 
 	// init disparity image to -10
 	if (param.subsampling) {
@@ -829,120 +1197,127 @@ void Elas::computeDisparity(vector<support_pt> p_support,vector<triangle> tri,in
 			*(D+i) = -10;
 	}
 
-	// pre-compute prior
-	float two_sigma_squared = 2*param.sigma*param.sigma;
-	int32_t* P = new int32_t[disp_num];
-	for (int32_t delta_d=0; delta_d<disp_num; delta_d++)
-		P[delta_d] = (int32_t)((-log(param.gamma+exp(-delta_d*delta_d/two_sigma_squared))+log(param.gamma))/param.beta);
+	// prior radius (the prior itself is pre-computed in the workspace)
 	int32_t plane_radius = (int32_t)max((float)ceil(param.sigma*param.sradius),(float)2.0);
 
-	// loop variables
-	int32_t c1, c2, c3;
-	float plane_a,plane_b,plane_c,plane_d;
-	uint32_t i;
-
-	// for all triangles do
-#pragma omp parallel for num_threads(3) default(none)\
-	private(i, plane_a, plane_b, plane_c, plane_d, c1, c2, c3)\
-	shared(P, plane_radius, two_sigma_squared, disp_num, window_size, p_support, tri, disparity_grid, grid_dims, I1_desc, I2_desc, right_image, D)
-	for (i=0; i<tri.size(); i++) {
+	// the image is split into tiles of tile_width columns (several tiles per
+	// thread), each tile matches all triangles overlapping it, clipped to the
+	// tile. since every pixel is owned by exactly one tile and triangles are
+	// visited in their original order, the result does not depend on the
+	// number of threads, and the dynamic schedule balances the very
+	// different costs of textureless and cluttered image regions
+	int32_t num_threads = getNumThreads();
+	int32_t tile_width  = max(width/(8*num_threads),16);
+	tile_width         += tile_width%2;
+	int32_t num_tiles   = (width+tile_width-1)/tile_width;
+
+	// sort triangles into tiles (counting sort: count, prefix sum, fill)
+	vector<int32_t> &tile_offset    = tile_offsets[right_image];
+	vector<int32_t> &tile_triangle  = tile_triangles[right_image];
+	tile_offset.assign(num_tiles+1,0);
+	for (int32_t pass=0; pass<2; pass++) {
+		for (int32_t i=0; i<(int32_t)tri.size(); i++) {
+
+			// column range [u_min,u_max) covered by this triangle
+			int32_t u_min = width,u_max = 0;
+			int32_t c[3]  = {tri[i].c1,tri[i].c2,tri[i].c3};
+			for (int32_t j=0; j<3; j++) {
+				int32_t u = p_support[c[j]].u;
+				if (right_image) u -= p_support[c[j]].d;
+				u_min = min(u_min,u);
+				u_max = max(u_max,u);
+			}
+			u_min = max(u_min,0);
+			u_max = min(u_max,width);
+			if (u_min>=u_max)
+				continue;
 
-		//printf("Matching thread %d\n", omp_get_thread_num());
-		// get plane parameters
-		uint32_t p_i = i*3;
-		if (!right_image) {
-			plane_a = tri[i].t1a;
-			plane_b = tri[i].t1b;
-			plane_c = tri[i].t1c;
-			plane_d = tri[i].t2a;
-		} else {
-			plane_a = tri[i].t2a;
-			plane_b = tri[i].t2b;
-			plane_c = tri[i].t2c;
-			plane_d = tri[i].t1a;
+			// count or insert triangle
+			for (int32_t t=u_min/tile_width; t<=(u_max-1)/tile_width; t++) {
+				if (pass==0) tile_offset[t+1]++;
+				else         tile_triangle[tile_offset[t]++] = i;
+			}
 		}
 
-		// triangle corners
-		c1 = tri[i].c1;
-		c2 = tri[i].c2;
-		c3 = tri[i].c3;
-
-		// sort triangle corners wrt. u (ascending)
-		float tri_u[3];
-		if (!right_image) {
-			tri_u[0] = p_support[c1].u;
-			tri_u[1] = p_support[c2].u;
-			tri_u[2] = p_support[c3].u;
+		// prefix sum after counting, restore offsets after inserting
+		if (pass==0) {
+			for (int32_t t=0; t<num_tiles; t++)
+				tile_offset[t+1] += tile_offset[t];
+			tile_triangle.resize(tile_offset[num_tiles]);
 		} else {
-			tri_u[0] = p_support[c1].u-p_support[c1].d;
-			tri_u[1] = p_support[c2].u-p_support[c2].d;
-			tri_u[2] = p_support[c3].u-p_support[c3].d;
+			for (int32_t t=num_tiles; t>0; t--)
+				tile_offset[t] = tile_offset[t-1];
+			tile_offset[0] = 0;
 		}
-		float tri_v[3] = {p_support[c1].v,p_support[c2].v,p_support[c3].v};
+	}
 
-		for (uint32_t j=0; j<3; j++) {
-			for (uint32_t k=0; k<j; k++) {
-				if (tri_u[k]>tri_u[j]) {
-					float tri_u_temp = tri_u[j]; tri_u[j] = tri_u[k]; tri_u[k] = tri_u_temp;
-					float tri_v_temp = tri_v[j]; tri_v[j] = tri_v[k]; tri_v[k] = tri_v_temp;
-				}
-			}
-		}
+	// for all tiles do
+	int64_t num_sad   = 0;
+	int32_t num_prior = 0;
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic) reduction(+:num_sad,num_prior)
+	for (int32_t t=0; t<num_tiles; t++) {
+		int32_t u_begin = t*tile_width;
+		int32_t u_end   = min(u_begin+tile_width,width);
+		match_candidates cand = {};
+		for (int32_t i=tile_offset[t]; i<tile_offset[t+1]; i++)
+			computeDisparityTriangle(p_support,tri[tile_triangle[i]],u_begin,u_end,disparity_grid,grid_dims,
+					I1_desc,I2_desc,plane_radius,right_image,D,D_prev,cand,num_sad,num_prior);
+	}
+#pragma omp atomic
+	stat.num_sad_evaluations += num_sad;
+#pragma omp atomic
+	stat.num_prior_matches += num_prior;
+}
 
-		// rename corners
-		float A_u = tri_u[0]; float A_v = tri_v[0];
-		float B_u = tri_u[1]; float B_v = tri_v[1];
-		float C_u = tri_u[2]; float C_v = tri_v[2];
-
-		// compute straight lines connecting triangle corners
-		float AB_a = 0; float AC_a = 0; float BC_a = 0;
-		if ((int32_t)(A_u)!=(int32_t)(B_u)) AB_a = (A_v-B_v)/(A_u-B_u);
-		if ((int32_t)(A_u)!=(int32_t)(C_u)) AC_a = (A_v-C_v)/(A_u-C_u);
-		if ((int32_t)(B_u)!=(int32_t)(C_u)) BC_a = (B_v-C_v)/(B_u-C_u);
-		float AB_b = A_v-AB_a*A_u;
-		float AC_b = A_v-AC_a*A_u;
-		float BC_b = B_v-BC_a*B_u;
-
-		// a plane is only valid if itself and its projection
-		// into the other image is not too much slanted
-		bool valid = fabs(plane_a)<0.7 && fabs(plane_d)<0.7;
-
-		// first part (triangle corner A->B)
-		if ((int32_t)(A_u)!=(int32_t)(B_u)) {
-			for (int32_t u=max((int32_t)A_u,0); u<min((int32_t)B_u,width); u++){
-				if (!param.subsampling || u%2==0) {
-					int32_t v_1 = (uint32_t)(AC_a*(float)u+AC_b);
-					int32_t v_2 = (uint32_t)(AB_a*(float)u+AB_b);
-					for (int32_t v=min(v_1,v_2); v<max(v_1,v_2); v++)
-						if (!param.subsampling || v%2==0) {
-							findMatch(u,v,plane_a,plane_b,plane_c,disparity_grid,grid_dims,
-									I1_desc,I2_desc,P,plane_radius,valid,right_image,D);
-						}
-				}
-			}
-		}
+inline int32_t Elas::checkConsistencyRow (const float* D_row,const float* D_row_other,float* D_out,int32_t D_width,float warp) {
+
+	// a disparity d at u is kept if it is valid, u+warp*d lies inside of the
+	// image and the disparity of the other image there differs by at most
+	// lr_threshold, otherwise it is set to -10
+	float   threshold   = param.lr_threshold;
+	int32_t num_invalid = 0;
+
+	// 4 pixels at once, the disparities of the other image are gathered by scalar loads
+	__m128  xzero    = _mm_set1_ps(0);
+	__m128  xwidth   = _mm_set1_ps(D_width);
+	__m128  xlast    = _mm_set1_ps(D_width-1);
+	__m128  xwarp    = _mm_set1_ps(warp);
+	__m128  xthresh  = _mm_set1_ps(threshold);
+	__m128  xinvalid = _mm_set1_ps(-10);
+	__m128  xabsmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128  xu       = _mm_setr_ps(0,1,2,3);
+	__m128  xfour    = _mm_set1_ps(4);
+	int32_t idx[4];
+	int32_t u = 0;
+	for (; u+4<=D_width; u+=4, xu=_mm_add_ps(xu,xfour)) {
+		__m128 xd      = _mm_loadu_ps(D_row+u);
+		__m128 xu_warp = _mm_add_ps(xu,_mm_mul_ps(xd,xwarp));
+		__m128 xvalid  = _mm_cmpge_ps(xd,xzero);
+		__m128 xinside = _mm_and_ps(xvalid,_mm_and_ps(_mm_cmpge_ps(xu_warp,xzero),_mm_cmplt_ps(xu_warp,xwidth)));
+		_mm_storeu_si128((__m128i*)idx,_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(xu_warp,xzero),xlast)));
+		__m128 xother  = _mm_setr_ps(D_row_other[idx[0]],D_row_other[idx[1]],D_row_other[idx[2]],D_row_other[idx[3]]);
+		__m128 xfail   = _mm_cmpgt_ps(_mm_and_ps(_mm_sub_ps(xother,xd),xabsmask),xthresh);
+		__m128 xkeep   = _mm_andnot_ps(xfail,xinside);
+		_mm_storeu_ps(D_out+u,_mm_or_ps(_mm_and_ps(xkeep,xd),_mm_andnot_ps(xkeep,xinvalid)));
+		int32_t mask   = _mm_movemask_ps(_mm_andnot_ps(xkeep,xvalid));
+		num_invalid   += (mask&1)+((mask>>1)&1)+((mask>>2)&1)+((mask>>3)&1);
+	}
 
-		// second part (triangle corner B->C)
-		if ((int32_t)(B_u)!=(int32_t)(C_u)) {
-			for (int32_t u=max((int32_t)B_u,0); u<min((int32_t)C_u,width); u++){
-				if (!param.subsampling || u%2==0) {
-					int32_t v_1 = (uint32_t)(AC_a*(float)u+AC_b);
-					int32_t v_2 = (uint32_t)(BC_a*(float)u+BC_b);
-					for (int32_t v=min(v_1,v_2); v<max(v_1,v_2); v++)
-						if (!param.subsampling || v%2==0) {
-							findMatch(u,v,plane_a,plane_b,plane_c,disparity_grid,grid_dims,
-									I1_desc,I2_desc,P,plane_radius,valid,right_image,D);
-						}
-				}
-			}
+	// remaining pixels
+	for (; u<D_width; u++) {
+		float d      = D_row[u];
+		float u_warp = (float)u+d*warp;
+		if (d>=0 && u_warp>=0 && u_warp<D_width && fabs(D_row_other[(int32_t)u_warp]-d)<=threshold) {
+			D_out[u] = d;
+		} else {
+			if (d>=0) num_invalid++;
+			D_out[u] = -10;
 		}
-
 	}
-
-	delete[] P;
+	return num_invalid;
 }
 
-void Elas::leftRightConsistencyCheck(float* D1,float* D2) {
+int32_t Elas::leftRightConsistencyCheck(const float* D1_in,const float* D2_in,float* D1,float* D2) {
 
 	// get disparity image dimensions
 	int32_t D_width  = width;
@@ -952,69 +1327,71 @@ void Elas::leftRightConsistencyCheck(float* D1,float* D2) {
 		D_height = height/2;
 	}
 
-	// make a copy of both images
-	float* D1_copy = (float*)malloc(D_width*D_height*sizeof(float));
-	float* D2_copy = (float*)malloc(D_width*D_height*sizeof(float));
-	memcpy(D1_copy,D1,D_width*D_height*sizeof(float));
-	memcpy(D2_copy,D2,D_width*D_height*sizeof(float));
-
-	// loop variables
-	uint32_t addr,addr_warp;
-	float    u_warp_1,u_warp_2,d1,d2;
-
-	// for all image points do
-	for (int32_t u=0; u<D_width; u++) {
-		for (int32_t v=0; v<D_height; v++) {
-
-			// compute address (u,v) and disparity value
-			addr     = getAddressOffsetImage(u,v,D_width);
-			d1       = *(D1_copy+addr);
-			d2       = *(D2_copy+addr);
-			if (param.subsampling) {
-				u_warp_1 = (float)u-d1/2;
-				u_warp_2 = (float)u+d2/2;
-			} else {
-				u_warp_1 = (float)u-d1;
-				u_warp_2 = (float)u+d2;
-			}
-
-
-			// check if left disparity is valid
-			if (d1>=0 && u_warp_1>=0 && u_warp_1<D_width) {
-
-				// compute warped image address
-				addr_warp = getAddressOffsetImage((int32_t)u_warp_1,v,D_width);
+	// warping left: u-d, right: u+d (in disparity image coordinates)
+	float scale = param.subsampling ? 0.5f : 1.0f;
 
-				// if check failed
-				if (fabs(*(D2_copy+addr_warp)-d1)>param.lr_threshold)
-					*(D1+addr) = -10;
+	// number of valid disparities which get invalidated
+	int32_t num_invalid = 0;
 
-				// set invalid
-			} else
-				*(D1+addr) = -10;
+	// pixels are only compared within their row, hence if the check runs in
+	// place (D1_in = D1) each row of both images is copied to the row pair of
+	// its thread first
+	int32_t num_threads = getNumThreads();
+	lr_rows.resize(2*D_width*num_threads);
+	#pragma omp parallel num_threads(num_threads) reduction(+:num_invalid)
+	{
+	float* D1_row = &lr_rows[2*D_width*omp_get_thread_num()];
+	float* D2_row = D1_row+D_width;
 
-			// check if right disparity is valid
-			if (d2>=0 && u_warp_2>=0 && u_warp_2<D_width) {
+	#pragma omp for
+	for (int32_t v=0; v<D_height; v++) {
+		float*       D1_line = D1+getAddressOffsetImage(0,v,D_width);
+		float*       D2_line = D2+getAddressOffsetImage(0,v,D_width);
+		const float* D1_in_line = D1_in+getAddressOffsetImage(0,v,D_width);
+		const float* D2_in_line = D2_in+getAddressOffsetImage(0,v,D_width);
+		if (D1_in==D1) {
+			memcpy(D1_row,D1_line,D_width*sizeof(float));
+			memcpy(D2_row,D2_line,D_width*sizeof(float));
+			D1_in_line = D1_row;
+			D2_in_line = D2_row;
+		}
+		num_invalid += checkConsistencyRow(D1_in_line,D2_in_line,D1_line,D_width,-scale);
+		num_invalid += checkConsistencyRow(D2_in_line,D1_in_line,D2_line,D_width,+scale);
+	}
+	}
+	return num_invalid;
+}
 
-				// compute warped image address
-				addr_warp = getAddressOffsetImage((int32_t)u_warp_2,v,D_width);
+inline int32_t Elas::findSegment (int32_t i) {
+	while (seg_parent[i]>=0)
+		i = seg_parent[i];
+	return i;
+}
 
-				// if check failed
-				if (fabs(*(D1_copy+addr_warp)-d2)>param.lr_threshold)
-					*(D2+addr) = -10;
+inline void Elas::mergeSegments (int32_t i,int32_t j) {
 
-				// set invalid
-			} else
-				*(D2+addr) = -10;
-		}
+	// find both roots (path halving)
+	while (seg_parent[i]>=0) {
+		if (seg_parent[seg_parent[i]]>=0)
+			seg_parent[i] = seg_parent[seg_parent[i]];
+		i = seg_parent[i];
 	}
+	while (seg_parent[j]>=0) {
+		if (seg_parent[seg_parent[j]]>=0)
+			seg_parent[j] = seg_parent[seg_parent[j]];
+		j = seg_parent[j];
+	}
+	if (i==j)
+		return;
 
-	// release memory
-	free(D1_copy);
-	free(D2_copy);
+	// attach the smaller segment to the larger one
+	if (seg_parent[i]>seg_parent[j])
+		swap(i,j);
+	seg_parent[i] += seg_parent[j];
+	seg_parent[j]  = i;
 }
 
-void Elas::removeSmallSegments (float* D) {
+int32_t Elas::removeSmallSegments (float* D) {
 
 	// get disparity image dimensions
 	int32_t D_width        = width;
@@ -1026,112 +1403,63 @@ void Elas::removeSmallSegments (float* D) {
 		D_speckle_size = sqrt((float)param.speckle_size)*2;
 	}
 
-	// allocate memory on heap for dynamic programming arrays
-	int32_t *D_done     = (int32_t*)calloc(D_width*D_height,sizeof(int32_t));
-	int32_t *seg_list_u = (int32_t*)calloc(D_width*D_height,sizeof(int32_t));
-	int32_t *seg_list_v = (int32_t*)calloc(D_width*D_height,sizeof(int32_t));
-	int32_t seg_list_count;
-	int32_t seg_list_curr;
-	int32_t u_neighbor[4];
-	int32_t v_neighbor[4];
-	int32_t u_seg_curr;
-	int32_t v_seg_curr;
-
-	// declare loop variables
-	int32_t addr_start, addr_curr, addr_neighbor;
-
-	// for all pixels do
-	for (int32_t u=0; u<D_width; u++) {
-		for (int32_t v=0; v<D_height; v++) {
-
-			// get address of first pixel in this segment
-			addr_start = getAddressOffsetImage(u,v,D_width);
-
-			// if this pixel has not already been processed
-			if (*(D_done+addr_start)==0) {
-
-				// init segment list (add first element
-				// and set it to be the next element to check)
-				*(seg_list_u+0) = u;
-				*(seg_list_v+0) = v;
-				seg_list_count  = 1;
-				seg_list_curr   = 0;
-
-				// add neighboring segments as long as there
-				// are none-processed pixels in the seg_list;
-				// none-processed means: seg_list_curr<seg_list_count
-				while (seg_list_curr<seg_list_count) {
-
-					// get current position from seg_list
-					u_seg_curr = *(seg_list_u+seg_list_curr);
-					v_seg_curr = *(seg_list_v+seg_list_curr);
-
-					// get address of current pixel in this segment
-					addr_curr = getAddressOffsetImage(u_seg_curr,v_seg_curr,D_width);
-
-					// fill list with neighbor positions
-					u_neighbor[0] = u_seg_curr-1; v_neighbor[0] = v_seg_curr;
-					u_neighbor[1] = u_seg_curr+1; v_neighbor[1] = v_seg_curr;
-					u_neighbor[2] = u_seg_curr;   v_neighbor[2] = v_seg_curr-1;
-					u_neighbor[3] = u_seg_curr;   v_neighbor[3] = v_seg_curr+1;
-
-					// for all neighbors do
-					for (int32_t i=0; i<4; i++) {
-
-						// check if neighbor is inside image
-						if (u_neighbor[i]>=0 && v_neighbor[i]>=0 && u_neighbor[i]<D_width && v_neighbor[i]<D_height) {
-
-							// get neighbor pixel address
-							addr_neighbor = getAddressOffsetImage(u_neighbor[i],v_neighbor[i],D_width);
-
-							// check if neighbor has not been added yet and if it is valid
-							if (*(D_done+addr_neighbor)==0 && *(D+addr_neighbor)>=0) {
-
-								// is the neighbor similar to the current pixel
-								// (=belonging to the current segment)
-								if (fabs(*(D+addr_curr)-*(D+addr_neighbor))<=param.speckle_sim_threshold) {
-
-									// add neighbor coordinates to segment list
-									*(seg_list_u+seg_list_count) = u_neighbor[i];
-									*(seg_list_v+seg_list_count) = v_neighbor[i];
-									seg_list_count++;
-
-									// set neighbor pixel in I_done to "done"
-									// (otherwise a pixel may be added 2 times to the list, as
-									//  neighbor of one pixel and as neighbor of another pixel)
-									*(D_done+addr_neighbor) = 1;
-								}
-							}
-
-						}
-					}
-
-					// set current pixel in seg_list to "done"
-					seg_list_curr++;
-
-					// set current pixel in I_done to "done"
-					*(D_done+addr_curr) = 1;
-
-				} // end: while (seg_list_curr<seg_list_count)
-
-				// if segment NOT large enough => invalidate pixels
-				if (seg_list_count<D_speckle_size) {
-
-					// for all pixels in current segment invalidate pixels
-					for (int32_t i=0; i<seg_list_count; i++) {
-						addr_curr = getAddressOffsetImage(*(seg_list_u+i),*(seg_list_v+i),D_width);
-						*(D+addr_curr) = -10;
-					}
-				}
-			} // end: if (*(I_done+addr_start)==0)
+	// segments are the connected components of valid pixels whose 4-neighbors
+	// differ by at most speckle_sim_threshold, each invalid pixel is a segment
+	// of its own (the l/r check sets all invalid pixels to -10)
+	float   sim_threshold = param.speckle_sim_threshold;
+	int32_t num_threads   = getNumThreads();
+
+	// 1. union-find within bands of rows, each band only touches its own pixels
+	int32_t num_bands   = min(4*num_threads,D_height);
+	int32_t band_height = (D_height+num_bands-1)/num_bands;
+	#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+	for (int32_t b=0; b<num_bands; b++) {
+		int32_t v_begin = b*band_height;
+		int32_t v_end   = min(v_begin+band_height,D_height);
+		for (int32_t v=v_begin; v<v_end; v++) {
+			const float* D_line = D+getAddressOffsetImage(0,v,D_width);
+			int32_t      addr   = getAddressOffsetImage(0,v,D_width);
+			for (int32_t u=0; u<D_width; u++,addr++) {
+				seg_parent[addr] = -1;
+				float d = D_line[u];
+				if (d<0)
+					continue;
+				if (u>0 && D_line[u-1]>=0 && fabs(d-D_line[u-1])<=sim_threshold)
+					mergeSegments(addr,addr-1);
+				if (v>v_begin && D_line[u-D_width]>=0 && fabs(d-D_line[u-D_width])<=sim_threshold)
+					mergeSegments(addr,addr-D_width);
+			}
+		}
+	}
 
+	// 2. merge the segments across band borders
+	for (int32_t b=1; b<num_bands; b++) {
+		int32_t v = b*band_height;
+		if (v>=D_height)
+			break;
+		const float* D_line = D+getAddressOffsetImage(0,v,D_width);
+		int32_t      addr   = getAddressOffsetImage(0,v,D_width);
+		for (int32_t u=0; u<D_width; u++,addr++) {
+			float d = D_line[u];
+			if (d>=0 && D_line[u-D_width]>=0 && fabs(d-D_line[u-D_width])<=sim_threshold)
+				mergeSegments(addr,addr-D_width);
 		}
 	}
 
-	// free memory
-	free(D_done);
-	free(seg_list_u);
-	free(seg_list_v);
+	// 3. invalidate all pixels of segments which are NOT large enough
+	// (seg_parent is only read from here on)
+	int32_t num_invalid = 0;
+	#pragma omp parallel for num_threads(num_threads) reduction(+:num_invalid)
+	for (int32_t v=0; v<D_height; v++) {
+		int32_t addr = getAddressOffsetImage(0,v,D_width);
+		for (int32_t u=0; u<D_width; u++,addr++) {
+			if (-seg_parent[findSegment(addr)]<D_speckle_size) {
+				if (*(D+addr)>=0) num_invalid++;
+				*(D+addr) = -10;
+			}
+		}
+	}
+	return num_invalid;
 }
 
 void Elas::gapInterpolation(float* D) {
@@ -1152,9 +1480,11 @@ void Elas::gapInterpolation(float* D) {
 	// declare loop variables
 	int32_t count,addr,v_first,v_last,u_first,u_last;
 	float   d1,d2,d_ipol;
+	int32_t num_threads = getNumThreads();
 
 	// 1. Row-wise:
 	// for each row do
+	#pragma omp parallel for num_threads(num_threads) private(count,addr,u_first,u_last,d1,d2,d_ipol)
 	for (int32_t v=0; v<D_height; v++) {
 
 		// init counter
@@ -1235,55 +1565,104 @@ void Elas::gapInterpolation(float* D) {
 	}
 
 	// 2. Column-wise:
-	// for each column do
-	for (int32_t u=0; u<D_width; u++) {
-
-		// init counter
-		count = 0;
-
-		// for each element of the column do
+	// the columns are processed in blocks of column_block columns which are
+	// traversed row by row, with one gap counter per column
+	const int32_t column_block = 256;
+	int32_t num_blocks = (D_width+column_block-1)/column_block;
+	#pragma omp parallel for num_threads(num_threads) private(addr,v_first,v_last,d1,d2,d_ipol)
+	for (int32_t b=0; b<num_blocks; b++) {
+		int32_t u_begin = b*column_block;
+		int32_t u_end   = min(u_begin+column_block,D_width);
+
+		// init counters
+		int32_t counts[column_block];
+		for (int32_t u=u_begin; u<u_end; u++)
+			counts[u-u_begin] = 0;
+
+		// for each element of the columns do
 		for (int32_t v=0; v<D_height; v++) {
+			for (int32_t u=u_begin; u<u_end; u++) {
 
-			// get address of this location
-			addr = getAddressOffsetImage(u,v,D_width);
+				// get address of this location
+				addr = getAddressOffsetImage(u,v,D_width);
+				int32_t &count_u = counts[u-u_begin];
 
-			// if disparity valid
-			if (*(D+addr)>=0) {
+				// if disparity valid
+				if (*(D+addr)>=0) {
 
-				// check if gap is small enough
-				if (count>=1 && count<=D_ipol_gap_width) {
+					// check if gap is small enough
+					if (count_u>=1 && count_u<=D_ipol_gap_width) {
 
-					// first and last value for interpolation
-					v_first = v-count;
-					v_last  = v-1;
+						// first and last value for interpolation
+						v_first = v-count_u;
+						v_last  = v-1;
 
-					// if value in range
-					if (v_first>0 && v_last<D_height-1) {
+						// if value in range
+						if (v_first>0 && v_last<D_height-1) {
 
-						// compute mean disparity
-						d1 = *(D+getAddressOffsetImage(u,v_first-1,D_width));
-						d2 = *(D+getAddressOffsetImage(u,v_last+1,D_width));
-						if (fabs(d1-d2)<discon_threshold) d_ipol = (d1+d2)/2;
-						else                              d_ipol = min(d1,d2);
+							// compute mean disparity
+							d1 = *(D+getAddressOffsetImage(u,v_first-1,D_width));
+							d2 = *(D+getAddressOffsetImage(u,v_last+1,D_width));
+							if (fabs(d1-d2)<discon_threshold) d_ipol = (d1+d2)/2;
+							else                              d_ipol = min(d1,d2);
 
-						// set all values to d_ipol
-						for (int32_t v_curr=v_first; v_curr<=v_last; v_curr++)
-							*(D+getAddressOffsetImage(u,v_curr,D_width)) = d_ipol;
-					}
+							// set all values to d_ipol
+							for (int32_t v_curr=v_first; v_curr<=v_last; v_curr++)
+								*(D+getAddressOffsetImage(u,v_curr,D_width)) = d_ipol;
+						}
 
-				}
+					}
 
-				// reset counter
-				count = 0;
+					// reset counter
+					count_u = 0;
 
-				// otherwise increment counter
-			} else {
-				count++;
+					// otherwise increment counter
+				} else {
+					count_u++;
+				}
 			}
 		}
 	}
 }
 
+// weight and factor sums of the bilateral approximation for 4 neighboring pixels:
+// D_tap points to the first of taps (4 or 8) values per pixel, consecutive taps
+// are stride floats apart and tap taps/2 is the pixel itself. invalid values
+// count as -10, which gives them zero weight next to valid disparities
+inline void Elas::adaptiveMeanSums (const float* D_tap,int32_t stride,int32_t taps,__m128 &xweight_sum,__m128 &xfactor_sum) {
+	const __m128 xzero    = _mm_set1_ps(0);
+	const __m128 xfour    = _mm_set1_ps(4);
+	const __m128 xinvalid = _mm_set1_ps(-10);
+
+	// "absolute mask" of the original filter: this is the float 2^31 (not the bit
+	// pattern), hence the AND clears the sign and the mantissa of val-center and
+	// keeps 5 of its exponent bits. kept as is, the filter has been tuned with it
+	const __m128 xabsmask = _mm_set1_ps(0x7FFFFFFF);
+
+	// load taps (zeroed, taps is not known at compile time)
+	__m128 xval[8] = {};
+	for (int32_t k=0; k<taps; k++) {
+		__m128 x = _mm_loadu_ps(D_tap+k*stride);
+		__m128 m = _mm_cmplt_ps(x,xzero);
+		xval[k]  = _mm_or_ps(_mm_and_ps(m,xinvalid),_mm_andnot_ps(m,x));
+	}
+	__m128 xcenter = xval[taps/2];
+
+	// weight = max(0,4-|val-center|), factor = val*weight. with 8 taps, taps
+	// k and k+4 are added first (as the 4 lanes of the former ring buffer)
+	for (int32_t k=0; k<4; k++) {
+		__m128 xweight = _mm_max_ps(xzero,_mm_sub_ps(xfour,_mm_and_ps(_mm_sub_ps(xval[k],xcenter),xabsmask)));
+		__m128 xfactor = _mm_mul_ps(xval[k],xweight);
+		if (taps==8) {
+			__m128 xweight2 = _mm_max_ps(xzero,_mm_sub_ps(xfour,_mm_and_ps(_mm_sub_ps(xval[k+4],xcenter),xabsmask)));
+			xfactor = _mm_add_ps(xfactor,_mm_mul_ps(xval[k+4],xweight2));
+			xweight = _mm_add_ps(xweight,xweight2);
+		}
+		xweight_sum = k==0 ? xweight : _mm_add_ps(xweight_sum,xweight);
+		xfactor_sum = k==0 ? xfactor : _mm_add_ps(xfactor_sum,xfactor);
+	}
+}
+
 // implements approximation to bilateral filtering
 void Elas::adaptiveMean (float* D) {
 
@@ -1295,201 +1674,109 @@ void Elas::adaptiveMean (float* D) {
 		D_height         = height/2;
 	}
 
-	// allocate temporary memory
-	float* D_copy = (float*)malloc(D_width*D_height*sizeof(float));
-	float* D_tmp  = (float*)malloc(D_width*D_height*sizeof(float));
-	memcpy(D_copy,D,D_width*D_height*sizeof(float));
-
-	// zero input disparity maps to -10 (this makes the bilateral
-	// weights of all valid disparities to 0 in this region)
-	for (int32_t i=0; i<D_width*D_height; i++) {
-		if (*(D+i)<0) {
-			*(D_copy+i) = -10;
-			*(D_tmp+i)  = -10;
-		}
-	}
-
-	__m128 xconst0 = _mm_set1_ps(0);
-	__m128 xconst4 = _mm_set1_ps(4);
-	__m128 xval,xweight1,xweight2,xfactor1,xfactor2;
-
-	float *val     = (float *)_mm_malloc(8*sizeof(float),16);
-	float *weight  = (float*)_mm_malloc(4*sizeof(float),16);
-	float *factor  = (float*)_mm_malloc(4*sizeof(float),16);
-
-	// set absolute mask
-	__m128 xabsmask = _mm_set1_ps(0x7FFFFFFF);
-
-	// when doing subsampling: 4 pixel bilateral filter width
-	if (param.subsampling) {
-
-		// horizontal filter
-		for (int32_t v=3; v<D_height-3; v++) {
-
-			// init
-			for (int32_t u=0; u<3; u++)
-				val[u] = *(D_copy+v*D_width+u);
+	// bilateral filter width: 4 pixels when subsampling, otherwise 8 pixels,
+	// the window of pixel c covers [c-taps/2,c+taps/2-1]
+	int32_t taps = param.subsampling ? 4 : 8;
+	int32_t half = taps/2;
 
-			// loop
-			for (int32_t u=3; u<D_width; u++) {
+	// a pixel takes the weighted mean if any weight is positive and the mean
+	// is valid, otherwise it keeps its value (horizontal filter: with invalid
+	// disparities set to -10, vertical filter: the input value)
+	const __m128 xzero = _mm_set1_ps(0);
 
-				// set
-				float val_curr = *(D_copy+v*D_width+(u-1));
-				val[u%4] = *(D_copy+v*D_width+u);
-
-				xval     = _mm_load_ps(val);
-				xweight1 = _mm_sub_ps(xval,_mm_set1_ps(val_curr));
-				xweight1 = _mm_and_ps(xweight1,xabsmask);
-				xweight1 = _mm_sub_ps(xconst4,xweight1);
-				xweight1 = _mm_max_ps(xconst0,xweight1);
-				xfactor1 = _mm_mul_ps(xval,xweight1);
-
-				_mm_store_ps(weight,xweight1);
-				_mm_store_ps(factor,xfactor1);
+	// filter rows (D -> D_temp) and then columns (D_temp -> D), both row by row,
+	// 4 pixels at a time, each row in parallel
+	#pragma omp parallel num_threads(getNumThreads())
+	{
+	__m128 xweight_sum,xfactor_sum;
+	float  weight_sum[4],factor_sum[4];
 
-				float weight_sum = weight[0]+weight[1]+weight[2]+weight[3];
-				float factor_sum = factor[0]+factor[1]+factor[2]+factor[3];
+	// the last pixels of a row / column are filtered one at a time,
+	// their taps are copied to lane 0 of D_tap
+	float  D_tap[4*8] = {0};
 
-				if (weight_sum>0) {
-					float d = factor_sum/weight_sum;
-					if (d>=0) *(D_tmp+v*D_width+(u-1)) = d;
-				}
-			}
+	// horizontal filter (rows without filtering are copied)
+	#pragma omp for
+	for (int32_t v=0; v<D_height; v++) {
+		const float* D_line   = D+getAddressOffsetImage(0,v,D_width);
+		float*       D_output = D_temp+getAddressOffsetImage(0,v,D_width);
+		for (int32_t u=0; u<D_width; u++)
+			D_output[u] = D_line[u]<0 ? -10 : D_line[u];
+		if (v<3 || v>=D_height-3)
+			continue;
+		int32_t c = half;
+		for (; c+4<=D_width-half+1; c+=4) {
+			adaptiveMeanSums(D_line+c-half,1,taps,xweight_sum,xfactor_sum);
+			__m128 xd     = _mm_div_ps(xfactor_sum,xweight_sum);
+			__m128 xvalid = _mm_and_ps(_mm_cmpgt_ps(xweight_sum,xzero),_mm_cmpge_ps(xd,xzero));
+			__m128 xout   = _mm_loadu_ps(D_output+c);
+			_mm_storeu_ps(D_output+c,_mm_or_ps(_mm_and_ps(xvalid,xd),_mm_andnot_ps(xvalid,xout)));
 		}
-
-		// vertical filter
-		for (int32_t u=3; u<D_width-3; u++) {
-
-			// init
-			for (int32_t v=0; v<3; v++)
-				val[v] = *(D_tmp+v*D_width+u);
-
-			// loop
-			for (int32_t v=3; v<D_height; v++) {
-
-				// set
-				float val_curr = *(D_tmp+(v-1)*D_width+u);
-				val[v%4] = *(D_tmp+v*D_width+u);
-
-				xval     = _mm_load_ps(val);
-				xweight1 = _mm_sub_ps(xval,_mm_set1_ps(val_curr));
-				xweight1 = _mm_and_ps(xweight1,xabsmask);
-				xweight1 = _mm_sub_ps(xconst4,xweight1);
-				xweight1 = _mm_max_ps(xconst0,xweight1);
-				xfactor1 = _mm_mul_ps(xval,xweight1);
-
-				_mm_store_ps(weight,xweight1);
-				_mm_store_ps(factor,xfactor1);
-
-				float weight_sum = weight[0]+weight[1]+weight[2]+weight[3];
-				float factor_sum = factor[0]+factor[1]+factor[2]+factor[3];
-
-				if (weight_sum>0) {
-					float d = factor_sum/weight_sum;
-					if (d>=0) *(D+(v-1)*D_width+u) = d;
-				}
+		for (; c<=D_width-half; c++) {
+			for (int32_t k=0; k<taps; k++)
+				D_tap[4*k] = D_line[c-half+k];
+			adaptiveMeanSums(D_tap,4,taps,xweight_sum,xfactor_sum);
+			_mm_storeu_ps(weight_sum,xweight_sum);
+			_mm_storeu_ps(factor_sum,xfactor_sum);
+			if (weight_sum[0]>0) {
+				float d = factor_sum[0]/weight_sum[0];
+				if (d>=0) D_output[c] = d;
 			}
 		}
+	}
 
-		// full resolution: 8 pixel bilateral filter width
-	} else {
-
-
-		// horizontal filter
-		for (int32_t v=3; v<D_height-3; v++) {
-
-			// init
-			for (int32_t u=0; u<7; u++)
-				val[u] = *(D_copy+v*D_width+u);
-
-			// loop
-			for (int32_t u=7; u<D_width; u++) {
-
-				// set
-				float val_curr = *(D_copy+v*D_width+(u-3));
-				val[u%8] = *(D_copy+v*D_width+u);
-
-				xval     = _mm_load_ps(val);
-				xweight1 = _mm_sub_ps(xval,_mm_set1_ps(val_curr));
-				xweight1 = _mm_and_ps(xweight1,xabsmask);
-				xweight1 = _mm_sub_ps(xconst4,xweight1);
-				xweight1 = _mm_max_ps(xconst0,xweight1);
-				xfactor1 = _mm_mul_ps(xval,xweight1);
-
-				xval     = _mm_load_ps(val+4);
-				xweight2 = _mm_sub_ps(xval,_mm_set1_ps(val_curr));
-				xweight2 = _mm_and_ps(xweight2,xabsmask);
-				xweight2 = _mm_sub_ps(xconst4,xweight2);
-				xweight2 = _mm_max_ps(xconst0,xweight2);
-				xfactor2 = _mm_mul_ps(xval,xweight2);
-
-				xweight1 = _mm_add_ps(xweight1,xweight2);
-				xfactor1 = _mm_add_ps(xfactor1,xfactor2);
-
-				_mm_store_ps(weight,xweight1);
-				_mm_store_ps(factor,xfactor1);
-
-				float weight_sum = weight[0]+weight[1]+weight[2]+weight[3];
-				float factor_sum = factor[0]+factor[1]+factor[2]+factor[3];
-
-				if (weight_sum>0) {
-					float d = factor_sum/weight_sum;
-					if (d>=0) *(D_tmp+v*D_width+(u-3)) = d;
-				}
-			}
+	// vertical filter
+	#pragma omp for
+	for (int32_t c=half; c<=D_height-half; c++) {
+		const float* D_input = D_temp+getAddressOffsetImage(0,c-half,D_width);
+		float*       D_line  = D+getAddressOffsetImage(0,c,D_width);
+		int32_t u = 3;
+		for (; u+4<=D_width-3; u+=4) {
+			adaptiveMeanSums(D_input+u,D_width,taps,xweight_sum,xfactor_sum);
+			__m128 xd     = _mm_div_ps(xfactor_sum,xweight_sum);
+			__m128 xvalid = _mm_and_ps(_mm_cmpgt_ps(xweight_sum,xzero),_mm_cmpge_ps(xd,xzero));
+			__m128 xout   = _mm_loadu_ps(D_line+u);
+			_mm_storeu_ps(D_line+u,_mm_or_ps(_mm_and_ps(xvalid,xd),_mm_andnot_ps(xvalid,xout)));
 		}
-
-		// vertical filter
-		for (int32_t u=3; u<D_width-3; u++) {
-
-			// init
-			for (int32_t v=0; v<7; v++)
-				val[v] = *(D_tmp+v*D_width+u);
-
-			// loop
-			for (int32_t v=7; v<D_height; v++) {
-
-				// set
-				float val_curr = *(D_tmp+(v-3)*D_width+u);
-				val[v%8] = *(D_tmp+v*D_width+u);
-
-				xval     = _mm_load_ps(val);
-				xweight1 = _mm_sub_ps(xval,_mm_set1_ps(val_curr));
-				xweight1 = _mm_and_ps(xweight1,xabsmask);
-				xweight1 = _mm_sub_ps(xconst4,xweight1);
-				xweight1 = _mm_max_ps(xconst0,xweight1);
-				xfactor1 = _mm_mul_ps(xval,xweight1);
-
-				xval     = _mm_load_ps(val+4);
-				xweight2 = _mm_sub_ps(xval,_mm_set1_ps(val_curr));
-				xweight2 = _mm_and_ps(xweight2,xabsmask);
-				xweight2 = _mm_sub_ps(xconst4,xweight2);
-				xweight2 = _mm_max_ps(xconst0,xweight2);
-				xfactor2 = _mm_mul_ps(xval,xweight2);
-
-				xweight1 = _mm_add_ps(xweight1,xweight2);
-				xfactor1 = _mm_add_ps(xfactor1,xfactor2);
-
-				_mm_store_ps(weight,xweight1);
-				_mm_store_ps(factor,xfactor1);
-
-				float weight_sum = weight[0]+weight[1]+weight[2]+weight[3];
-				float factor_sum = factor[0]+factor[1]+factor[2]+factor[3];
-
-				if (weight_sum>0) {
-					float d = factor_sum/weight_sum;
-					if (d>=0) *(D+(v-3)*D_width+u) = d;
-				}
+		for (; u<D_width-3; u++) {
+			for (int32_t k=0; k<taps; k++)
+				D_tap[4*k] = D_input[k*D_width+u];
+			adaptiveMeanSums(D_tap,4,taps,xweight_sum,xfactor_sum);
+			_mm_storeu_ps(weight_sum,xweight_sum);
+			_mm_storeu_ps(factor_sum,xfactor_sum);
+			if (weight_sum[0]>0) {
+				float d = factor_sum[0]/weight_sum[0];
+				if (d>=0) D_line[u] = d;
 			}
 		}
 	}
+	}
+}
+
+// compare-exchange networks: 13 min/max pairs select the median of 7 values
+// (the 4th smallest), exactly as a full sort would
+inline float Elas::median7 (float* p) {
+	static const int32_t pairs[13][2] = {{0,5},{0,3},{1,6},{2,4},{0,1},{3,5},{2,6},
+	                                     {2,3},{3,6},{4,5},{1,4},{1,3},{3,4}};
+	for (int32_t i=0; i<13; i++) {
+		float a = p[pairs[i][0]];
+		float b = p[pairs[i][1]];
+		p[pairs[i][0]] = min(a,b);
+		p[pairs[i][1]] = max(a,b);
+	}
+	return p[3];
+}
 
-	// free memory
-	_mm_free(val);
-	_mm_free(weight);
-	_mm_free(factor);
-	free(D_copy);
-	free(D_tmp);
+inline __m128 Elas::median7 (__m128* p) {
+	static const int32_t pairs[13][2] = {{0,5},{0,3},{1,6},{2,4},{0,1},{3,5},{2,6},
+	                                     {2,3},{3,6},{4,5},{1,4},{1,3},{3,4}};
+	for (int32_t i=0; i<13; i++) {
+		__m128 a = p[pairs[i][0]];
+		__m128 b = p[pairs[i][1]];
+		p[pairs[i][0]] = _mm_min_ps(a,b);
+		p[pairs[i][1]] = _mm_max_ps(a,b);
+	}
+	return p[3];
 }
 
 void Elas::median (float* D) {
@@ -1502,60 +1789,66 @@ void Elas::median (float* D) {
 		D_height         = height/2;
 	}
 
-	// temporary memory
-	float *D_temp = (float*)calloc(D_width*D_height,sizeof(float));
+	const int32_t window_size = 3;
 
-	int32_t window_size = 3;
+	// temporary memory (rows not touched by the horizontal filter read as zero)
+	for (int32_t v=0; v<D_height; v++)
+		if (v<window_size || v>=D_height-window_size)
+			memset(D_temp+v*D_width,0,D_width*sizeof(float));
 
-	float *vals = new float[window_size*2+1];
-	int32_t i,j;
-	float temp;
+	// both steps filter valid pixels only, invalid ones keep their value.
+	// rows are independent, each row is filtered 4 pixels at a time
+	int32_t num_threads = getNumThreads();
+	__m128  xzero       = _mm_set1_ps(0);
 
 	// first step: horizontal median filter
-	for (int32_t u=window_size; u<D_width-window_size; u++) {
-		for (int32_t v=window_size; v<D_height-window_size; v++) {
-			if (*(D+getAddressOffsetImage(u,v,D_width))>=0) {
-				j = 0;
-				for (int32_t u2=u-window_size; u2<=u+window_size; u2++) {
-					temp = *(D+getAddressOffsetImage(u2,v,D_width));
-					i = j-1;
-					while (i>=0 && *(vals+i)>temp) {
-						*(vals+i+1) = *(vals+i);
-						i--;
-					}
-					*(vals+i+1) = temp;
-					j++;
-				}
-				*(D_temp+getAddressOffsetImage(u,v,D_width)) = *(vals+window_size);
+	#pragma omp parallel for num_threads(num_threads)
+	for (int32_t v=window_size; v<D_height-window_size; v++) {
+		const float* D_line    = D+getAddressOffsetImage(0,v,D_width);
+		float*       D_out     = D_temp+getAddressOffsetImage(0,v,D_width);
+		__m128       xvals[window_size*2+1];
+		float        vals[window_size*2+1];
+		int32_t      u = window_size;
+		for (; u+4<=D_width-window_size; u+=4) {
+			for (int32_t k=0; k<2*window_size+1; k++)
+				xvals[k] = _mm_loadu_ps(D_line+u-window_size+k);
+			__m128 xd     = xvals[window_size];
+			__m128 xvalid = _mm_cmpge_ps(xd,xzero);
+			__m128 xmed   = median7(xvals);
+			_mm_storeu_ps(D_out+u,_mm_or_ps(_mm_and_ps(xvalid,xmed),_mm_andnot_ps(xvalid,xd)));
+		}
+		for (; u<D_width-window_size; u++) {
+			if (D_line[u]>=0) {
+				memcpy(vals,D_line+u-window_size,(2*window_size+1)*sizeof(float));
+				D_out[u] = median7(vals);
 			} else {
-				*(D_temp+getAddressOffsetImage(u,v,D_width)) = *(D+getAddressOffsetImage(u,v,D_width));
+				D_out[u] = D_line[u];
 			}
-
 		}
 	}
 
 	// second step: vertical median filter
-	for (int32_t u=window_size; u<D_width-window_size; u++) {
-		for (int32_t v=window_size; v<D_height-window_size; v++) {
-			if (*(D+getAddressOffsetImage(u,v,D_width))>=0) {
-				j = 0;
-				for (int32_t v2=v-window_size; v2<=v+window_size; v2++) {
-					temp = *(D_temp+getAddressOffsetImage(u,v2,D_width));
-					i = j-1;
-					while (i>=0 && *(vals+i)>temp) {
-						*(vals+i+1) = *(vals+i);
-						i--;
-					}
-					*(vals+i+1) = temp;
-					j++;
-				}
-				*(D+getAddressOffsetImage(u,v,D_width)) = *(vals+window_size);
-			} else {
-				*(D+getAddressOffsetImage(u,v,D_width)) = *(D+getAddressOffsetImage(u,v,D_width));
+	#pragma omp parallel for num_threads(num_threads)
+	for (int32_t v=window_size; v<D_height-window_size; v++) {
+		const float* D_temp_line = D_temp+getAddressOffsetImage(0,v-window_size,D_width);
+		float*       D_line      = D+getAddressOffsetImage(0,v,D_width);
+		__m128       xvals[window_size*2+1];
+		float        vals[window_size*2+1];
+		int32_t      u = window_size;
+		for (; u+4<=D_width-window_size; u+=4) {
+			for (int32_t k=0; k<2*window_size+1; k++)
+				xvals[k] = _mm_loadu_ps(D_temp_line+k*D_width+u);
+			__m128 xd     = _mm_loadu_ps(D_line+u);
+			__m128 xvalid = _mm_cmpge_ps(xd,xzero);
+			__m128 xmed   = median7(xvals);
+			_mm_storeu_ps(D_line+u,_mm_or_ps(_mm_and_ps(xvalid,xmed),_mm_andnot_ps(xvalid,xd)));
+		}
+		for (; u<D_width-window_size; u++) {
+			if (D_line[u]>=0) {
+				for (int32_t k=0; k<2*window_size+1; k++)
+					vals[k] = D_temp_line[k*D_width+u];
+				D_line[u] = median7(vals);
 			}
 		}
 	}
-
-	free(D_temp);
-	free(vals);
 }
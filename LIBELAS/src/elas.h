@@ -30,7 +30,8 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 #include <stdlib.h>
 #include <vector>
 #include <emmintrin.h>
-//#define PROFILE 1
+#include "descriptor.h"
+#include "delaunay.h"
 
 // define fixed-width datatypes for Visual Studio projects
 #ifndef _MSC_VER
@@ -46,9 +47,8 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
   typedef unsigned __int64  uint64_t;
 #endif
 
-#ifdef PROFILE
-#include "timer.h"
-#endif
+// reentrant triangulation engine of triangle.h
+struct triangulateengine;
 
 class Elas {
 
@@ -83,6 +83,21 @@ public:
     bool    subsampling;            // saves time by only computing disparities for each 2nd pixel
                                     // note: for this option D1 and D2 must be passed with size
                                     //       width/2 x height/2 (rounded towards zero)
+    bool    fast_triangulation;     // exact integer Delaunay triangulation of the support points
+                                    // (falls back to Triangle for very large images), it splits
+                                    // cocircular points differently and changes the output slightly
+    bool    temporal_support;       // video streams: support matches of the previous frame are verified
+                                    // in a narrow disparity window first, only failures are fully searched.
+                                    // a triangulation is reused if no support point changed, with
+                                    // fast_triangulation it is updated incrementally if few changed
+    int32_t temporal_radius;        // half width of the disparity window of temporal_support
+    int32_t temporal_refresh;       // temporal_support: candidates without a previous match are searched
+                                    // every temporal_refresh-th frame only (staggered over the grid)
+    int32_t prior_radius;           // dense matching with previous disparity maps (see process()):
+                                    // half width of the disparity band around the previous value (0 = off)
+    int32_t prior_max_cost;         // band matches with a higher matching energy are searched fully
+    int32_t num_threads;            // number of threads used by all parallel stages
+                                    // (0 = OpenMP default, e.g. OMP_NUM_THREADS or #cores)
 
     // constructor
     parameters (setting s=ROBOTICS) {
@@ -114,6 +129,13 @@ public:
         filter_adaptive_mean  = 1;
         postprocess_only_left = 1;
         subsampling           = 0;
+        fast_triangulation    = 0;
+        temporal_support      = 0;
+        temporal_radius       = 4;
+        temporal_refresh      = 2;
+        prior_radius          = 2;
+        prior_max_cost        = 400;
+        num_threads           = 0;
 
       // default settings for middlebury benchmark
       // (interpolate all missing disparities)
@@ -141,15 +163,52 @@ public:
         filter_adaptive_mean  = 0;
         postprocess_only_left = 0;
         subsampling           = 0;
+        fast_triangulation    = 0;
+        temporal_support      = 0;
+        temporal_radius       = 4;
+        temporal_refresh      = 2;
+        prior_radius          = 2;
+        prior_max_cost        = 400;
+        num_threads           = 0;
       }
     }
   };
 
+  // runtime statistics of one call to process() / processInPlace()
+  // durations are in milliseconds (monotonic clock), each stage covers
+  // both images unless only the left one is postprocessed
+  struct stats {
+    double  descriptor;            // descriptor computation
+    double  support_matches;       // support point matching
+    double  triangulation;         // delaunay triangulation and disparity planes
+    double  grid;                  // disparity grid
+    double  matching;              // dense matching
+    double  lr_check;              // left/right consistency check
+    double  remove_small_segments; // speckle removal
+    double  gap_interpolation;     // gap interpolation
+    double  filtering;             // adaptive mean and median filter
+    double  total;                 // whole call, including the input copy
+    int32_t num_support_points;    // support points (including corners)
+    int32_t num_triangles;         // triangles of left and right image
+    int64_t num_sad_evaluations;   // matching cost evaluations (support and dense matching)
+    int32_t num_invalid_lr;        // valid pixels invalidated by the l/r check
+    int32_t num_invalid_segments;  // valid pixels invalidated by the speckle removal
+    int32_t num_support_reused;    // support candidates verified around the previous frame's disparity
+    int32_t num_triangulations_reused; // triangulations (left/right) taken over unchanged from the previous frame
+    int32_t num_triangulations_updated; // triangulations (left/right) updated incrementally from the previous frame
+    int32_t num_prior_matches;     // pixels matched in the band around their previous disparity
+    stats () : descriptor(0),support_matches(0),triangulation(0),grid(0),matching(0),
+               lr_check(0),remove_small_segments(0),gap_interpolation(0),filtering(0),total(0),
+               num_support_points(0),num_triangles(0),num_sad_evaluations(0),
+               num_invalid_lr(0),num_invalid_segments(0),num_support_reused(0),
+               num_triangulations_reused(0),num_triangulations_updated(0),num_prior_matches(0) {}
+  };
+
   // constructor, input: parameters
-  Elas (parameters param) : param(param) {}
+  Elas (parameters param);
 
-  // deconstructor
-  ~Elas () {}
+  // deconstructor, releases the workspace
+  ~Elas ();
 
   // matching function
   // inputs: pointers to left (I1) and right (I2) intensity image (uint8, input)
@@ -160,10 +219,32 @@ public:
   //         note: D1 and D2 must be allocated before (bytes per line = width)
   //               if subsampling is not active their size is width x height,
   //               otherwise width/2 x height/2 (rounded towards zero)
-  void process (uint8_t* I1,uint8_t* I2,float* D1,float* D2,const int32_t* dims);
+  //         all internal memory is allocated on the first call and reused by
+  //         subsequent calls, it is only reallocated if width or height change
+  //         optional (video): disparity maps of the previous frame (D1_prev, D2_prev),
+  //         same size as D1 and D2 (they may be D1 and D2 themselves). valid pixels
+  //         are matched in a band around their previous disparity (prior_radius)
+  //         and only searched fully if the match is poor (prior_max_cost)
+  // returns: runtime statistics of this call
+  stats process (uint8_t* I1,uint8_t* I2,float* D1,float* D2,const int32_t* dims,
+                 const float* D1_prev=0,const float* D2_prev=0);
+
+  // matching function without input copy, same inputs as process()
+  // I1 and I2 are read in place if both are 16 byte aligned and dims[2] is a
+  // multiple of 16 (and >= dims[0]), in this case all dims[2]*dims[1] bytes of
+  // both images must be readable. otherwise this falls back to process().
+  stats processInPlace (uint8_t* I1,uint8_t* I2,float* D1,float* D2,const int32_t* dims,
+                        const float* D1_prev=0,const float* D2_prev=0);
+
+  // with temporal_support the next call starts from scratch (e.g. after a scene cut)
+  void resetTemporal ();
 
 private:
 
+  // the workspace is owned by this object, hence no copies
+  Elas (const Elas&);
+  Elas& operator= (const Elas&);
+
   struct support_pt {
     int32_t u;
     int32_t v;
@@ -178,6 +259,16 @@ private:
     triangle(int32_t c1,int32_t c2,int32_t c3):c1(c1),c2(c2),c3(c3){}
   };
 
+  // disparity grid: the ascending disparities of cell i (row major) are
+  // disp[offset[i]] .. disp[offset[i+1]-1], all cells packed in one array
+  struct grid_lists {
+    std::vector<int32_t>  offset;
+    std::vector<uint16_t> disp;
+  };
+
+  // number of threads used by the parallel stages
+  int32_t getNumThreads ();
+
   inline uint32_t getAddressOffsetImage (const int32_t& u,const int32_t& v,const int32_t& width) {
     return v*width+u;
   }
@@ -186,52 +277,115 @@ private:
     return (y*width+x)*disp_num+d;
   }
 
+  inline uint32_t getAddressOffsetGridCell (const int32_t& x,const int32_t& y,const int32_t& width) {
+    return y*width+x;
+  }
+
+  // number of 64 bit words of a disparity bitset (one bit per disparity 0..disp_max)
+  inline int32_t getGridWords () {
+    return (param.disp_max+64)/64;
+  }
+
   // support point functions
   void removeInconsistentSupportPoints (int16_t* D_can,int32_t D_can_width,int32_t D_can_height);
   void removeRedundantSupportPoints (int16_t* D_can,int32_t D_can_width,int32_t D_can_height,
                                      int32_t redun_max_dist, int32_t redun_threshold, bool vertical);
   void addCornerSupportPoints (std::vector<support_pt> &p_support);
-  inline int16_t computeMatchingDisparity (const int32_t &u,const int32_t &v,uint8_t* I1_desc,uint8_t* I2_desc,const bool &right_image);
-  std::vector<support_pt> computeSupportMatches (uint8_t* I1_desc,uint8_t* I2_desc);
+  inline int16_t computeMatchingDisparity (const int32_t &u,const int32_t &v,uint8_t* I1_desc,uint8_t* I2_desc,const bool &right_image,
+                                           int64_t &num_sad,const int32_t d_search_min=-1,const int32_t d_search_max=-1);
+  void computeSupportMatches (uint8_t* I1_desc,uint8_t* I2_desc,std::vector<support_pt> &p_support);
 
   // triangulation & grid
-  std::vector<triangle> computeDelaunayTriangulation (std::vector<support_pt> p_support,int32_t right_image);
-  void computeDisparityPlanes (std::vector<support_pt> p_support,std::vector<triangle> &tri,int32_t right_image);
-  void createGrid (std::vector<support_pt> p_support,int32_t* disparity_grid,int32_t* grid_dims,bool right_image);
+  void computeDelaunayTriangulation (const std::vector<support_pt> &p_support,std::vector<triangle> &tri,int32_t right_image);
+  void triangulateGeneral (const std::vector<int32_t> &points,std::vector<int32_t> &corners,int32_t right_image);
+  void computeDisparityPlanes (const std::vector<support_pt> &p_support,std::vector<triangle> &tri,int32_t right_image);
+  static inline void solvePlanes (const __m128* u,const __m128* v,const __m128* d,__m128 &a,__m128 &b,__m128 &c);
+  void createGrid (const std::vector<support_pt> &p_support,grid_lists &disparity_grid,int32_t* grid_dims,bool right_image);
 
   // matching
-  inline void updatePosteriorMinimum (__m128i* I2_block_addr,const int32_t &d,const int32_t &w,
-                                      const __m128i &xmm1,__m128i &xmm2,int32_t &val,int32_t &min_val,int32_t &min_d);
-  inline void updatePosteriorMinimum (__m128i* I2_block_addr,const int32_t &d,
-                                      const __m128i &xmm1,__m128i &xmm2,int32_t &val,int32_t &min_val,int32_t &min_d);
+  static const int32_t findmatch_chunk = 32; // candidates per SAD kernel call in findMatch()
+  // candidates of findMatch() for one SAD kernel call: descriptor address, disparity
+  // and prior weight (one set per tile of computeDisparity(), not per pixel)
+  struct match_candidates {
+    const uint8_t* I2_block_addr[findmatch_chunk];
+    int32_t        d[findmatch_chunk];
+    int32_t        w[findmatch_chunk];
+  };
+  inline void updatePosteriorMinimum (uint8_t* I1_block_addr,const match_candidates &cand,int32_t n,
+                                      int32_t &min_val,int32_t &min_d,int64_t &num_sad);
   inline void findMatch (int32_t &u,int32_t &v,float &plane_a,float &plane_b,float &plane_c,
-                         int32_t* disparity_grid,int32_t *grid_dims,uint8_t* I1_desc,uint8_t* I2_desc,
-                         int32_t *P,int32_t &plane_radius,bool &valid,bool &right_image,float* D);
-  void computeDisparity (std::vector<support_pt> p_support,std::vector<triangle> tri,int32_t* disparity_grid,int32_t* grid_dims,
-                         uint8_t* I1_desc,uint8_t* I2_desc,bool right_image,float* D);
-
-  // L/R consistency check
-  void leftRightConsistencyCheck (float* D1,float* D2);
-
-  // postprocessing
-  void removeSmallSegments (float* D);
+                         const grid_lists &disparity_grid,int32_t *grid_dims,uint8_t* I1_desc,uint8_t* I2_desc,
+                         int32_t *P,int32_t &plane_radius,bool &valid,bool &right_image,float* D,const float* D_prev,
+                         match_candidates &cand,int64_t &num_sad,int32_t &num_prior);
+  inline void computeDisparityTriangle (const std::vector<support_pt> &p_support,const triangle &tri,int32_t u_begin,int32_t u_end,
+                                        const grid_lists &disparity_grid,int32_t *grid_dims,uint8_t* I1_desc,uint8_t* I2_desc,
+                                        int32_t plane_radius,bool right_image,float* D,const float* D_prev,
+                                        match_candidates &cand,int64_t &num_sad,int32_t &num_prior);
+  void computeDisparity (const std::vector<support_pt> &p_support,const std::vector<triangle> &tri,const grid_lists &disparity_grid,int32_t* grid_dims,
+                         uint8_t* I1_desc,uint8_t* I2_desc,bool right_image,float* D,const float* D_prev);
+
+  // L/R consistency check, returns the number of invalidated pixels
+  int32_t leftRightConsistencyCheck (const float* D1_in,const float* D2_in,float* D1,float* D2);
+  inline int32_t checkConsistencyRow (const float* D_row,const float* D_row_other,float* D_out,int32_t D_width,float warp);
+
+  // postprocessing (removeSmallSegments returns the number of invalidated pixels)
+  int32_t removeSmallSegments (float* D);
+  inline int32_t findSegment (int32_t i);           // root of pixel i in seg_parent
+  inline void    mergeSegments (int32_t i,int32_t j); // union by size
   void gapInterpolation (float* D);
 
   // optional postprocessing
   void adaptiveMean (float* D);
+  inline void adaptiveMeanSums (const float* D_tap,int32_t stride,int32_t taps,__m128 &xweight_sum,__m128 &xfactor_sum);
   void median (float* D);
+  static inline float  median7 (float* p);  // median of p[0..6] (sorting network, p is modified)
+  static inline __m128 median7 (__m128* p); // same for 4 independent lanes
+
+  // matching (in_place: read I1_ and I2_ directly, they must fulfill
+  // the alignment requirements stated at processInPlace())
+  void processImages (uint8_t* I1_,uint8_t* I2_,float* D1,float* D2,const int32_t* dims,bool in_place,
+                      const float* D1_prev,const float* D2_prev);
+
+  // sets t to the current time and returns the time elapsed since t (in ms)
+  static double getLapTime (double &t);
+
+  // workspace
+  void allocateWorkspace ();
+  void releaseWorkspace ();
 
   // parameter set
   parameters param;
 
-  // memory aligned input images + dimensions
+  // memory aligned input images (caller memory or I1_aligned/I2_aligned) + dimensions
   uint8_t *I1,*I2;
   int32_t width,height,bpl;
 
-  // profiling timer
-#ifdef PROFILE
-  Timer timer;
-#endif
+  // workspace: per-frame memory, sized for ws_width x ws_height
+  int32_t    ws_width,ws_height;
+  uint8_t   *I1_aligned,*I2_aligned;     // aligned input copies (allocated on demand)
+  Descriptor desc1,desc2;
+  uint64_t  *grid_temp[2];                 // createGrid (left/right): disparity bitsets of all cells
+  int16_t   *D_can;                        // support point candidates
+  int16_t   *D_can_prev;                   // l/r checked candidates of the previous frame (temporal_support)
+  bool       temporal_valid;               // D_can_prev and tri_corners belong to the previous frame
+  int32_t    temporal_frame;               // frames since the last full support search
+  int32_t   *P;                            // pre-computed matching prior
+  float     *D_temp;                       // adaptive mean, median
+  float     *D1_dense,*D2_dense;           // dense matching if D1_prev / D2_prev are D1 / D2 (allocated on demand)
+  int32_t   *seg_parent;                     // speckle removal: parent pixel, roots store -size
+  std::vector<support_pt> support_points;                 // support points of the current frame
+  std::vector< std::vector<support_pt> > support_partial; // computeSupportMatches (one list per thread)
+  std::vector<triangle> triangles[2];                     // triangulation (left/right)
+  grid_lists           disparity_grid_1,disparity_grid_2; // candidate disparities of the grid cells
+  std::vector<int32_t> tile_offsets[2],tile_triangles[2]; // computeDisparity (left/right)
+  std::vector<float>   lr_rows;                           // l/r check: one row of D1 and D2 per thread
+  Delaunay             tri_fast[2];                       // computeDelaunayTriangulation (left/right)
+  triangulateengine   *tri_engine[2];
+  std::vector<int32_t> tri_points[2],tri_corners[2];
+  std::vector<float>   tri_pointlist[2];                  // triangulateGeneral: input of Triangle
+
+  // statistics of the last call to process() / processInPlace()
+  stats stat;
 };
 
 #endif
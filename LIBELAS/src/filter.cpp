@@ -22,6 +22,7 @@ Street, Fifth Floor, Boston, MA 02110-1301, USA
 #include <stdio.h>
 #include <string.h>
 #include <cassert>
+#include <algorithm>
 
 #include "filter.h"
 
@@ -403,6 +404,22 @@ namespace filter {
         *(result_v+1) = _mm_add_epi16( *(result_v+1), ilo );
       }
     }
+    
+    void sobel3x3_8px( const __m128i t0, const __m128i t1, const __m128i t2, const __m128i c0, const __m128i c2,
+                       const __m128i b0, const __m128i b1, const __m128i b2, __m128i& v, __m128i& h ) {
+      __m128i offs = _mm_set1_epi16( 128 );
+      // (1,2,1) column smoothing, (1,0,-1) row derivative
+      __m128i s0 = _mm_add_epi16( _mm_add_epi16( t0, b0 ), _mm_add_epi16( c0, c0 ) );
+      __m128i s2 = _mm_add_epi16( _mm_add_epi16( t2, b2 ), _mm_add_epi16( c2, c2 ) );
+      v = _mm_srai_epi16( _mm_sub_epi16( s0, s2 ), 2 );
+      v = _mm_add_epi16( v, offs );
+      // (1,0,-1) column derivative, (1,2,1) row smoothing
+      __m128i d1 = _mm_sub_epi16( t1, b1 );
+      h = _mm_add_epi16( _mm_sub_epi16( t0, b0 ), _mm_sub_epi16( t2, b2 ) );
+      h = _mm_add_epi16( h, _mm_add_epi16( d1, d1 ) );
+      h = _mm_srai_epi16( h, 2 );
+      h = _mm_add_epi16( h, offs );
+    }
   };
   
   void sobel3x3( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int h ) {
@@ -415,6 +432,43 @@ namespace filter {
     _mm_free( temp_v );
   }
   
+  void sobel3x3_row( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int bpl ) {
+    const uint8_t* in_t = in - bpl;
+    const uint8_t* in_b = in + bpl;
+    int x = 1;
+    
+    // 16 pixels per iteration, reads columns x-1..x+16
+    for( ; x+16 < w; x += 16 ) {
+      __m128i t0lo, t0hi, t1lo, t1hi, t2lo, t2hi;
+      __m128i c0lo, c0hi, c2lo, c2hi;
+      __m128i b0lo, b0hi, b1lo, b1hi, b2lo, b2hi;
+      __m128i vlo, vhi, hlo, hhi;
+      detail::unpack_8bit_to_16bit( _mm_loadu_si128( (__m128i*)( in_t+x-1 ) ), t0lo, t0hi );
+      detail::unpack_8bit_to_16bit( _mm_loadu_si128( (__m128i*)( in_t+x   ) ), t1lo, t1hi );
+      detail::unpack_8bit_to_16bit( _mm_loadu_si128( (__m128i*)( in_t+x+1 ) ), t2lo, t2hi );
+      detail::unpack_8bit_to_16bit( _mm_loadu_si128( (__m128i*)( in  +x-1 ) ), c0lo, c0hi );
+      detail::unpack_8bit_to_16bit( _mm_loadu_si128( (__m128i*)( in  +x+1 ) ), c2lo, c2hi );
+      detail::unpack_8bit_to_16bit( _mm_loadu_si128( (__m128i*)( in_b+x-1 ) ), b0lo, b0hi );
+      detail::unpack_8bit_to_16bit( _mm_loadu_si128( (__m128i*)( in_b+x   ) ), b1lo, b1hi );
+      detail::unpack_8bit_to_16bit( _mm_loadu_si128( (__m128i*)( in_b+x+1 ) ), b2lo, b2hi );
+      detail::sobel3x3_8px( t0lo, t1lo, t2lo, c0lo, c2lo, b0lo, b1lo, b2lo, vlo, hlo );
+      detail::sobel3x3_8px( t0hi, t1hi, t2hi, c0hi, c2hi, b0hi, b1hi, b2hi, vhi, hhi );
+      __m128i result;
+      detail::pack_16bit_to_8bit_saturate( vlo, vhi, result );
+      _mm_storeu_si128( (__m128i*)( out_v+x ), result );
+      detail::pack_16bit_to_8bit_saturate( hlo, hhi, result );
+      _mm_storeu_si128( (__m128i*)( out_h+x ), result );
+    }
+    
+    // remaining pixels
+    for( ; x < w-1; x++ ) {
+      int v = ((in_t[x-1]+2*in[x-1]+in_b[x-1])-(in_t[x+1]+2*in[x+1]+in_b[x+1]))>>2;
+      int h = ((in_t[x-1]-in_b[x-1])+2*(in_t[x]-in_b[x])+(in_t[x+1]-in_b[x+1]))>>2;
+      out_v[x] = (uint8_t)std::max( 0, std::min( 255, v+128 ) );
+      out_h[x] = (uint8_t)std::max( 0, std::min( 255, h+128 ) );
+    }
+  }
+  
   void sobel5x5( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int h ) {
     int16_t* temp_h = (int16_t*)( _mm_malloc( w*h*sizeof( int16_t ), 16 ) );
     int16_t* temp_v = (int16_t*)( _mm_malloc( w*h*sizeof( int16_t ), 16 ) );
@@ -75,10 +75,20 @@ namespace filter {
     void convolve_row_p1p1p0m1m1_5x5( const int16_t* in, int16_t* out, int w, int h );
     
     void convolve_cols_3x3( const unsigned char* in, int16_t* out_v, int16_t* out_h, int w, int h );
+    
+    // 3x3 sobel responses of 8 pixels from 16bit input columns x-1 (*0), x (*1) and x+1 (*2)
+    // of the rows above (t), at (c) and below (b). Output is scaled and shifted as in sobel3x3.
+    void sobel3x3_8px( const __m128i t0, const __m128i t1, const __m128i t2, const __m128i c0, const __m128i c2,
+                       const __m128i b0, const __m128i b1, const __m128i b2, __m128i& v, __m128i& h );
   }
   
   void sobel3x3( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int h );
   
+  // single row of sobel3x3: in points to the first pixel of the row, the rows
+  // above and below are bpl bytes away. Columns 1..w-2 of out_v and out_h are
+  // written, the results are identical to those of sobel3x3.
+  void sobel3x3_row( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int bpl );
+  
   void sobel5x5( const uint8_t* in, uint8_t* out_v, uint8_t* out_h, int w, int h );
   
   // -1 -1  0  1  1
@@ -0,0 +1,239 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "matching.h"
+#include <emmintrin.h>
+
+// the AVX2 / AVX-512 kernels are compiled for their target only (the rest
+// of the library keeps the baseline instruction set) and selected at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #include <immintrin.h>
+  #define MATCHING_RUNTIME_DISPATCH
+  #define MATCHING_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace matching {
+
+  // private namespace (declared in matching.h), public user functions at the bottom of this file
+  namespace detail {
+
+    void sadBlock4_sse2 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost) {
+      __m128i xmm1 = _mm_load_si128((__m128i*)(I1_block+offset[0]));
+      __m128i xmm2 = _mm_load_si128((__m128i*)(I1_block+offset[1]));
+      __m128i xmm3 = _mm_load_si128((__m128i*)(I1_block+offset[2]));
+      __m128i xmm4 = _mm_load_si128((__m128i*)(I1_block+offset[3]));
+      __m128i xmm5,xmm6;
+      for (int32_t k=0; k<n; k++,I2_block+=16) {
+        xmm6 = _mm_load_si128((__m128i*)(I2_block+offset[0]));
+        xmm6 = _mm_sad_epu8(xmm1,xmm6);
+        xmm5 = _mm_load_si128((__m128i*)(I2_block+offset[1]));
+        xmm6 = _mm_add_epi16(_mm_sad_epu8(xmm2,xmm5),xmm6);
+        xmm5 = _mm_load_si128((__m128i*)(I2_block+offset[2]));
+        xmm6 = _mm_add_epi16(_mm_sad_epu8(xmm3,xmm5),xmm6);
+        xmm5 = _mm_load_si128((__m128i*)(I2_block+offset[3]));
+        xmm6 = _mm_add_epi16(_mm_sad_epu8(xmm4,xmm5),xmm6);
+        cost[k] = _mm_extract_epi16(xmm6,0)+_mm_extract_epi16(xmm6,4);
+      }
+    }
+
+    void sadList_sse2 (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost) {
+      __m128i xmm1 = _mm_load_si128((__m128i*)I1_block);
+      __m128i xmm2;
+      for (int32_t k=0; k<n; k++) {
+        xmm2    = _mm_load_si128((__m128i*)I2_block[k]);
+        xmm2    = _mm_sad_epu8(xmm1,xmm2);
+        cost[k] = _mm_extract_epi16(xmm2,0)+_mm_extract_epi16(xmm2,4);
+      }
+    }
+
+#ifdef MATCHING_RUNTIME_DISPATCH
+
+    // AVX2: two neighboring descriptors per 256 bit register
+    // (the per-descriptor sums of the 16 bit SAD halves never exceed 16 bit)
+    MATCHING_TARGET("avx2")
+    void sadBlock4_avx2 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost) {
+      __m256i ymm1 = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i*)(I1_block+offset[0])));
+      __m256i ymm2 = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i*)(I1_block+offset[1])));
+      __m256i ymm3 = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i*)(I1_block+offset[2])));
+      __m256i ymm4 = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i*)(I1_block+offset[3])));
+      __m256i ymm5,ymm6;
+      int32_t k=0;
+      for (; k+2<=n; k+=2,I2_block+=32) {
+        ymm6 = _mm256_loadu_si256((__m256i*)(I2_block+offset[0]));
+        ymm6 = _mm256_sad_epu8(ymm1,ymm6);
+        ymm5 = _mm256_loadu_si256((__m256i*)(I2_block+offset[1]));
+        ymm6 = _mm256_add_epi16(_mm256_sad_epu8(ymm2,ymm5),ymm6);
+        ymm5 = _mm256_loadu_si256((__m256i*)(I2_block+offset[2]));
+        ymm6 = _mm256_add_epi16(_mm256_sad_epu8(ymm3,ymm5),ymm6);
+        ymm5 = _mm256_loadu_si256((__m256i*)(I2_block+offset[3]));
+        ymm6 = _mm256_add_epi16(_mm256_sad_epu8(ymm4,ymm5),ymm6);
+        ymm6 = _mm256_add_epi16(ymm6,_mm256_srli_si256(ymm6,8));
+        cost[k]   = _mm256_extract_epi16(ymm6,0);
+        cost[k+1] = _mm256_extract_epi16(ymm6,8);
+      }
+      if (k<n)
+        sadBlock4_sse2(I1_block,I2_block,offset,n-k,cost+k);
+    }
+
+    MATCHING_TARGET("avx2")
+    void sadList_avx2 (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost) {
+      __m256i ymm1 = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i*)I1_block));
+      __m256i ymm2;
+      int32_t k=0;
+      for (; k+2<=n; k+=2) {
+        ymm2 = _mm256_castsi128_si256(_mm_load_si128((__m128i*)I2_block[k]));
+        ymm2 = _mm256_inserti128_si256(ymm2,_mm_load_si128((__m128i*)I2_block[k+1]),1);
+        ymm2 = _mm256_sad_epu8(ymm1,ymm2);
+        ymm2 = _mm256_add_epi16(ymm2,_mm256_srli_si256(ymm2,8));
+        cost[k]   = _mm256_extract_epi16(ymm2,0);
+        cost[k+1] = _mm256_extract_epi16(ymm2,8);
+      }
+      if (k<n)
+        sadList_sse2(I1_block,I2_block+k,n-k,cost+k);
+    }
+
+    // AVX-512BW: four neighboring descriptors per 512 bit register
+    MATCHING_TARGET("avx512f,avx512bw")
+    inline void storeCosts_avx512 (__m512i zmm,int32_t* cost) {
+      // sum both SAD halves of each descriptor and move the
+      // four sums (64 bit elements 0,2,4,6) to four 32 bit values
+      // (zero masked forms: the plain intrinsics pass undefined registers through)
+      zmm = _mm512_add_epi16(zmm,_mm512_bsrli_epi128(zmm,8));
+      zmm = _mm512_maskz_permutexvar_epi64(0xFF,_mm512_set_epi64(7,5,3,1,6,4,2,0),zmm);
+      _mm_storeu_si128((__m128i*)cost,_mm256_castsi256_si128(_mm512_maskz_cvtepi64_epi32(0xFF,zmm)));
+    }
+
+    MATCHING_TARGET("avx512f,avx512bw")
+    void sadBlock4_avx512 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost) {
+      __m512i zmm1 = _mm512_maskz_broadcast_i32x4(0xFFFF,_mm_load_si128((__m128i*)(I1_block+offset[0])));
+      __m512i zmm2 = _mm512_maskz_broadcast_i32x4(0xFFFF,_mm_load_si128((__m128i*)(I1_block+offset[1])));
+      __m512i zmm3 = _mm512_maskz_broadcast_i32x4(0xFFFF,_mm_load_si128((__m128i*)(I1_block+offset[2])));
+      __m512i zmm4 = _mm512_maskz_broadcast_i32x4(0xFFFF,_mm_load_si128((__m128i*)(I1_block+offset[3])));
+      __m512i zmm5,zmm6;
+      int32_t k=0;
+      for (; k+4<=n; k+=4,I2_block+=64) {
+        zmm6 = _mm512_loadu_si512((const void*)(I2_block+offset[0]));
+        zmm6 = _mm512_sad_epu8(zmm1,zmm6);
+        zmm5 = _mm512_loadu_si512((const void*)(I2_block+offset[1]));
+        zmm6 = _mm512_add_epi16(_mm512_sad_epu8(zmm2,zmm5),zmm6);
+        zmm5 = _mm512_loadu_si512((const void*)(I2_block+offset[2]));
+        zmm6 = _mm512_add_epi16(_mm512_sad_epu8(zmm3,zmm5),zmm6);
+        zmm5 = _mm512_loadu_si512((const void*)(I2_block+offset[3]));
+        zmm6 = _mm512_add_epi16(_mm512_sad_epu8(zmm4,zmm5),zmm6);
+        storeCosts_avx512(zmm6,cost+k);
+      }
+      if (k<n)
+        sadBlock4_avx2(I1_block,I2_block,offset,n-k,cost+k);
+    }
+
+    MATCHING_TARGET("avx512f,avx512bw")
+    void sadList_avx512 (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost) {
+      __m512i zmm1 = _mm512_maskz_broadcast_i32x4(0xFFFF,_mm_load_si128((__m128i*)I1_block));
+      __m512i zmm2;
+      int32_t k=0;
+      for (; k+4<=n; k+=4) {
+        zmm2 = _mm512_inserti32x4(_mm512_setzero_si512(),_mm_load_si128((__m128i*)I2_block[k]),0);
+        zmm2 = _mm512_inserti32x4(zmm2,_mm_load_si128((__m128i*)I2_block[k+1]),1);
+        zmm2 = _mm512_inserti32x4(zmm2,_mm_load_si128((__m128i*)I2_block[k+2]),2);
+        zmm2 = _mm512_inserti32x4(zmm2,_mm_load_si128((__m128i*)I2_block[k+3]),3);
+        storeCosts_avx512(_mm512_sad_epu8(zmm1,zmm2),cost+k);
+      }
+      if (k<n)
+        sadList_avx2(I1_block,I2_block+k,n-k,cost+k);
+    }
+
+#else
+
+    // without runtime dispatch all instruction sets use the SSE2 kernels
+    void sadBlock4_avx2 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost) {
+      sadBlock4_sse2(I1_block,I2_block,offset,n,cost);
+    }
+
+    void sadBlock4_avx512 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost) {
+      sadBlock4_sse2(I1_block,I2_block,offset,n,cost);
+    }
+
+    void sadList_avx2 (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost) {
+      sadList_sse2(I1_block,I2_block,n,cost);
+    }
+
+    void sadList_avx512 (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost) {
+      sadList_sse2(I1_block,I2_block,n,cost);
+    }
+
+#endif
+
+    // dispatch table
+    struct kernels {
+      instruction_set set;
+      void (*sadBlock4)(const uint8_t*,const uint8_t*,const int32_t*,int32_t,int32_t*);
+      void (*sadList)(const uint8_t*,const uint8_t* const*,int32_t,int32_t*);
+    };
+
+    kernels selectKernels (instruction_set s) {
+      kernels k;
+      k.set       = SSE2;
+      k.sadBlock4 = sadBlock4_sse2;
+      k.sadList   = sadList_sse2;
+#ifdef MATCHING_RUNTIME_DISPATCH
+      if (s==AVX2) {
+        k.set       = AVX2;
+        k.sadBlock4 = sadBlock4_avx2;
+        k.sadList   = sadList_avx2;
+      } else if (s==AVX512) {
+        k.set       = AVX512;
+        k.sadBlock4 = sadBlock4_avx512;
+        k.sadList   = sadList_avx512;
+      }
+#endif
+      return k;
+    }
+
+    // resolved once (thread-safe initialization), read-only afterwards
+    const kernels& getKernels () {
+      static const kernels k = selectKernels(detectInstructionSet());
+      return k;
+    }
+  }
+
+  instruction_set detectInstructionSet () {
+#ifdef MATCHING_RUNTIME_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
+      return AVX512;
+    if (__builtin_cpu_supports("avx2"))
+      return AVX2;
+#endif
+    return SSE2;
+  }
+
+  instruction_set getInstructionSet () {
+    return detail::getKernels().set;
+  }
+
+  void sadBlock4 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost) {
+    detail::getKernels().sadBlock4(I1_block,I2_block,offset,n,cost);
+  }
+
+  void sadList (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost) {
+    detail::getKernels().sadList(I1_block,I2_block,n,cost);
+  }
+};
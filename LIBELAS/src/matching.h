@@ -0,0 +1,78 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __MATCHING_H__
+#define __MATCHING_H__
+
+// define fixed-width datatypes for Visual Studio projects
+#ifndef _MSC_VER
+  #include <stdint.h>
+#else
+  typedef __int8            int8_t;
+  typedef __int16           int16_t;
+  typedef __int32           int32_t;
+  typedef __int64           int64_t;
+  typedef unsigned __int8   uint8_t;
+  typedef unsigned __int16  uint16_t;
+  typedef unsigned __int32  uint32_t;
+  typedef unsigned __int64  uint64_t;
+#endif
+
+// SAD kernels on 16 byte descriptors, used by support and dense matching.
+// the instruction set is selected at runtime (cpuid): SSE2 evaluates one
+// descriptor per _mm_sad_epu8, AVX2 two per 256 bit and AVX-512BW four per
+// 512 bit SAD. all variants produce identical costs.
+namespace matching {
+
+  enum instruction_set {SSE2,AVX2,AVX512};
+
+  // private namespace, public user functions below. the kernels of each
+  // instruction set (same contracts as sadBlock4 / sadList) are declared for
+  // the tests, the AVX2 / AVX-512 ones may only be called if the CPU supports
+  // them (see detectInstructionSet) and are the SSE2 ones on other compilers
+  namespace detail {
+    void sadBlock4_sse2 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost);
+    void sadBlock4_avx2 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost);
+    void sadBlock4_avx512 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost);
+    void sadList_sse2 (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost);
+    void sadList_avx2 (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost);
+    void sadList_avx512 (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost);
+  }
+
+  // best instruction set supported by this CPU and operating system
+  instruction_set detectInstructionSet ();
+
+  // instruction set used by the kernels (the detected one, resolved on first use)
+  instruction_set getInstructionSet ();
+
+  // support matching: SAD of four descriptors at the relative offsets
+  // offset[0..3] (in bytes) for n consecutive descriptors of the other image
+  //   cost[k] = sum_j SAD(I1_block+offset[j],I2_block+16*k+offset[j])
+  // I1_block and I2_block must be 16 byte aligned
+  void sadBlock4 (const uint8_t* I1_block,const uint8_t* I2_block,const int32_t* offset,int32_t n,int32_t* cost);
+
+  // dense matching: SAD of one descriptor against n arbitrary descriptors
+  //   cost[k] = SAD(I1_block,I2_block[k])
+  // all addresses must be 16 byte aligned
+  void sadList (const uint8_t* I1_block,const uint8_t* const* I2_block,int32_t n,int32_t* cost);
+}
+
+#endif
@@ -536,18 +536,15 @@ struct memorypool {
 };
 
 
-/* Global constants.                                                         */
+/* Global constants.  They are computed once by exactinit() and only read   */
+/*   afterwards, hence they may be shared by concurrent triangulations.      */
 
-float splitter;       /* Used to split float factors for exact multiplication. */
-float epsilon;                             /* Floating-point machine epsilon. */
-float resulterrbound;
-float ccwerrboundA, ccwerrboundB, ccwerrboundC;
-float iccerrboundA, iccerrboundB, iccerrboundC;
-float o3derrboundA, o3derrboundB, o3derrboundC;
-
-/* Random number seed is not constant, but I've made it global anyway.       */
-
-unsigned long randomseed;                     /* Current random number seed. */
+static float splitter; /* Used to split float factors for exact multiplication. */
+static float epsilon;                      /* Floating-point machine epsilon. */
+static float resulterrbound;
+static float ccwerrboundA, ccwerrboundB, ccwerrboundC;
+static float iccerrboundA, iccerrboundB, iccerrboundC;
+static float o3derrboundA, o3derrboundB, o3derrboundC;
 
 
 /* Mesh data structure.  Triangle operates on only one mesh, but the mesh    */
@@ -613,6 +610,8 @@ struct mesh {
   long circumcentercount;  /* Number of circumcenter calculations performed. */
   long circletopcount;       /* Number of circle top calculations performed. */
 
+  unsigned long randomseed;                   /* Current random number seed. */
+
 /* Triangular bounding box vertices.                                         */
 
   vertex infvertex1, infvertex2, infvertex3;
@@ -628,6 +627,12 @@ struct mesh {
 
   subseg *dummysub;
   subseg *dummysubbase;      /* Keep base address so we can free() it later. */
+  int dummytribytes, dummysubbytes;  /* Allocated sizes, kept for reuse. */
+
+/* Vertex pointers sorted by divconqdelaunay(), kept across triangulations.  */
+
+  vertex *sortarray;
+  int sortarraysize;
 
 /* Pointer to a recently visited triangle.  Improves point location if       */
 /*   proximate vertices are inserted sequentially.                           */
@@ -1634,6 +1639,21 @@ void poolrestart(struct memorypool *pool)
   pool->deaditemstack = (int *) NULL;
 }
 
+/*****************************************************************************/
+/*                                                                           */
+/*  pooldeinit()   Free to the operating system all memory taken by a pool.  */
+/*                                                                           */
+/*****************************************************************************/
+
+void pooldeinit(struct memorypool *pool)
+{
+  while (pool->firstblock != (int **) NULL) {
+    pool->nowblock = (int **) *(pool->firstblock);
+    trifree((int *) pool->firstblock);
+    pool->firstblock = pool->nowblock;
+  }
+}
+
 /*****************************************************************************/
 /*                                                                           */
 /*  poolinit()   Initialize a pool of memory for allocation of items.        */
@@ -1649,6 +1669,10 @@ void poolrestart(struct memorypool *pool)
 /*  `alignment' is normally used to create a few unused bits at the bottom   */
 /*  of each item's pointer, in which information may be stored.              */
 /*                                                                           */
+/*  If the pool still owns the blocks of a previous mesh (see                */
+/*  trianglerestart()) and their layout fits, they are reused instead of     */
+/*  being returned to the operating system and allocated again.              */
+/*                                                                           */
 /*  Don't change this routine unless you understand it.                      */
 /*                                                                           */
 /*****************************************************************************/
@@ -1656,24 +1680,40 @@ void poolrestart(struct memorypool *pool)
 void poolinit(struct memorypool *pool, int bytecount, int itemcount,
               int firstitemcount, int alignment)
 {
+  int alignbytes;
+  int itembytes;
+
   /* Find the proper alignment, which must be at least as large as:   */
   /*   - The parameter `alignment'.                                   */
   /*   - sizeof(int *), so the stack of dead items can be maintained */
   /*       without unaligned accesses.                                */
   if (alignment > sizeof(int *)) {
-    pool->alignbytes = alignment;
+    alignbytes = alignment;
   } else {
-    pool->alignbytes = sizeof(int *);
+    alignbytes = sizeof(int *);
   }
-  pool->itembytes = ((bytecount - 1) / pool->alignbytes + 1) *
-                    pool->alignbytes;
-  pool->itemsperblock = itemcount;
+  itembytes = ((bytecount - 1) / alignbytes + 1) * alignbytes;
   if (firstitemcount == 0) {
-    pool->itemsfirstblock = itemcount;
-  } else {
-    pool->itemsfirstblock = firstitemcount;
+    firstitemcount = itemcount;
   }
 
+  if (pool->firstblock != (int **) NULL) {
+    /* Recycle the blocks if the items fit, and the first block is at least */
+    /*   as large as requested.                                             */
+    if ((pool->alignbytes == alignbytes) && (pool->itembytes == itembytes) &&
+        (pool->itemsperblock == itemcount) &&
+        (pool->itemsfirstblock >= firstitemcount)) {
+      poolrestart(pool);
+      return;
+    }
+    pooldeinit(pool);
+  }
+
+  pool->alignbytes = alignbytes;
+  pool->itembytes = itembytes;
+  pool->itemsperblock = itemcount;
+  pool->itemsfirstblock = firstitemcount;
+
   /* Allocate a block of items.  Space for `itemsfirstblock' items and one  */
   /*   pointer (to point to the next block) are allocated, as well as space */
   /*   to ensure alignment of the items.                                    */
@@ -1685,21 +1725,6 @@ void poolinit(struct memorypool *pool, int bytecount, int itemcount,
   poolrestart(pool);
 }
 
-/*****************************************************************************/
-/*                                                                           */
-/*  pooldeinit()   Free to the operating system all memory taken by a pool.  */
-/*                                                                           */
-/*****************************************************************************/
-
-void pooldeinit(struct memorypool *pool)
-{
-  while (pool->firstblock != (int **) NULL) {
-    pool->nowblock = (int **) *(pool->firstblock);
-    trifree((int *) pool->firstblock);
-    pool->firstblock = pool->nowblock;
-  }
-}
-
 /*****************************************************************************/
 /*                                                                           */
 /*  poolalloc()   Allocate space for an item.                                */
@@ -1873,9 +1898,13 @@ void dummyinit(struct mesh *m, struct behavior *b, int trianglebytes,
 {
   unsigned long alignptr;
 
-  /* Set up `dummytri', the `triangle' that occupies "outer space." */
-  m->dummytribase = (triangle *) trimalloc(trianglebytes +
-                                           m->triangles.alignbytes);
+  /* Set up `dummytri', the `triangle' that occupies "outer space."  A    */
+  /*   restarted mesh reuses the dummy of its last triangulation.          */
+  if (m->dummytribytes != trianglebytes + m->triangles.alignbytes) {
+    trifree((int *) m->dummytribase);
+    m->dummytribytes = trianglebytes + m->triangles.alignbytes;
+    m->dummytribase = (triangle *) trimalloc(m->dummytribytes);
+  }
   /* Align `dummytri' on a `triangles.alignbytes'-byte boundary. */
   alignptr = (unsigned long) m->dummytribase;
   m->dummytri = (triangle *)
@@ -1897,8 +1926,11 @@ void dummyinit(struct mesh *m, struct behavior *b, int trianglebytes,
     /* Set up `dummysub', the omnipresent subsegment pointed to by any */
     /*   triangle side or subsegment end that isn't attached to a real */
     /*   subsegment.                                                   */
-    m->dummysubbase = (subseg *) trimalloc(subsegbytes +
-                                           m->subsegs.alignbytes);
+    if (m->dummysubbytes != subsegbytes + m->subsegs.alignbytes) {
+      trifree((int *) m->dummysubbase);
+      m->dummysubbytes = subsegbytes + m->subsegs.alignbytes;
+      m->dummysubbase = (subseg *) trimalloc(m->dummysubbytes);
+    }
     /* Align `dummysub' on a `subsegs.alignbytes'-byte boundary. */
     alignptr = (unsigned long) m->dummysubbase;
     m->dummysub = (subseg *)
@@ -2173,15 +2205,19 @@ vertex getvertex(struct mesh *m, struct behavior *b, int number)
 /*                                                                           */
 /*****************************************************************************/
 
-void triangledeinit(struct mesh *m, struct behavior *b)
+void triangledeinit(struct mesh *m)
 {
   pooldeinit(&m->triangles);
   trifree((int *) m->dummytribase);
-  if (b->usesegments) {
-    pooldeinit(&m->subsegs);
-    trifree((int *) m->dummysubbase);
-  }
+  pooldeinit(&m->subsegs);
+  trifree((int *) m->dummysubbase);
+  trifree((int *) m->sortarray);
   pooldeinit(&m->vertices);
+  pooldeinit(&m->viri);
+  pooldeinit(&m->badsubsegs);
+  pooldeinit(&m->badtriangles);
+  pooldeinit(&m->flipstackers);
+  pooldeinit(&m->splaynodes);
 }
 
 /**                                                                         **/
@@ -4003,6 +4039,26 @@ void findcircumcenter(struct mesh *m, struct behavior *b,
 /**                                                                         **/
 /********* Geometric primitives end here                             *********/
 
+/*****************************************************************************/
+/*                                                                           */
+/*  trianglerestart()   Reset the variables of a mesh for a new              */
+/*                      triangulation.  The memory pools are kept, and       */
+/*                      reused by poolinit().                                */
+/*                                                                           */
+/*****************************************************************************/
+
+void trianglerestart(struct mesh *m)
+{
+  m->recenttri.tri = (triangle *) NULL; /* No triangle has been visited yet. */
+  m->undeads = 0;                       /* No eliminated input vertices yet. */
+  m->samples = 1;         /* Point location should take at least one sample. */
+  m->checksegments = 0;   /* There are no segments in the triangulation yet. */
+  m->checkquality = 0;     /* The quality triangulation stage has not begun. */
+  m->incirclecount = m->counterclockcount = m->orient3dcount = 0;
+  m->hyperbolacount = m->circletopcount = m->circumcentercount = 0;
+  m->randomseed = 1;
+}
+
 /*****************************************************************************/
 /*                                                                           */
 /*  triangleinit()   Initialize some variables.                              */
@@ -4011,6 +4067,10 @@ void findcircumcenter(struct mesh *m, struct behavior *b,
 
 void triangleinit(struct mesh *m)
 {
+  /* Initialize exact arithmetic constants, once for all threads. */
+  static const int exactinitialized = (exactinit(), 1);
+
+  (void) exactinitialized;
   poolzero(&m->vertices);
   poolzero(&m->triangles);
   poolzero(&m->subsegs);
@@ -4019,17 +4079,14 @@ void triangleinit(struct mesh *m)
   poolzero(&m->badtriangles);
   poolzero(&m->flipstackers);
   poolzero(&m->splaynodes);
-
-  m->recenttri.tri = (triangle *) NULL; /* No triangle has been visited yet. */
-  m->undeads = 0;                       /* No eliminated input vertices yet. */
-  m->samples = 1;         /* Point location should take at least one sample. */
-  m->checksegments = 0;   /* There are no segments in the triangulation yet. */
-  m->checkquality = 0;     /* The quality triangulation stage has not begun. */
-  m->incirclecount = m->counterclockcount = m->orient3dcount = 0;
-  m->hyperbolacount = m->circletopcount = m->circumcentercount = 0;
-  randomseed = 1;
-
-  exactinit();                     /* Initialize exact arithmetic constants. */
+  m->dummytribase = (triangle *) NULL;
+  m->dummysubbase = (subseg *) NULL;
+  m->dummytribytes = 0;
+  m->dummysubbytes = 0;
+  m->sortarray = (vertex *) NULL;
+  m->sortarraysize = 0;
+
+  trianglerestart(m);
 }
 
 /*****************************************************************************/
@@ -4042,10 +4099,10 @@ void triangleinit(struct mesh *m)
 /*                                                                           */
 /*****************************************************************************/
 
-unsigned long randomnation(unsigned int choices)
+unsigned long randomnation(struct mesh *m, unsigned int choices)
 {
-  randomseed = (randomseed * 1366l + 150889l) % 714025l;
-  return randomseed / (714025l / choices + 1);
+  m->randomseed = (m->randomseed * 1366l + 150889l) % 714025l;
+  return m->randomseed / (714025l / choices + 1);
 }
 
 /********* Point location routines begin here                        *********/
@@ -4376,7 +4433,8 @@ enum locateresult locate(struct mesh *m, struct behavior *b,
     /* Choose `samplesleft' randomly sampled triangles in this block. */
     do {
       sampletri.tri = (triangle *) (firsttri +
-                                    (randomnation((unsigned int) population) *
+                                    (randomnation(m, (unsigned int)
+                                                  population) *
                                      m->triangles.itembytes));
       if (!deadtri(sampletri.tri)) {
         org(sampletri, torg);
@@ -5443,7 +5501,7 @@ void triangulatepolygon(struct mesh *m, struct behavior *b,
 /*                                                                           */
 /*****************************************************************************/
 
-void vertexsort(vertex *sortarray, int arraysize)
+void vertexsort(struct mesh *m, vertex *sortarray, int arraysize)
 {
   int left, right;
   int pivot;
@@ -5462,7 +5520,7 @@ void vertexsort(vertex *sortarray, int arraysize)
     return;
   }
   /* Choose a random pivot to split the array. */
-  pivot = (int) randomnation((unsigned int) arraysize);
+  pivot = (int) randomnation(m, (unsigned int) arraysize);
   pivotx = sortarray[pivot][0];
   pivoty = sortarray[pivot][1];
   /* Split the array. */
@@ -5490,11 +5548,11 @@ void vertexsort(vertex *sortarray, int arraysize)
   }
   if (left > 1) {
     /* Recursively sort the left subset. */
-    vertexsort(sortarray, left);
+    vertexsort(m, sortarray, left);
   }
   if (right < arraysize - 2) {
     /* Recursively sort the right subset. */
-    vertexsort(&sortarray[right + 1], arraysize - right - 1);
+    vertexsort(m, &sortarray[right + 1], arraysize - right - 1);
   }
 }
 
@@ -5510,7 +5568,8 @@ void vertexsort(vertex *sortarray, int arraysize)
 /*                                                                           */
 /*****************************************************************************/
 
-void vertexmedian(vertex *sortarray, int arraysize, int median, int axis)
+void vertexmedian(struct mesh *m, vertex *sortarray, int arraysize,
+                  int median, int axis)
 {
   int left, right;
   int pivot;
@@ -5529,7 +5588,7 @@ void vertexmedian(vertex *sortarray, int arraysize, int median, int axis)
     return;
   }
   /* Choose a random pivot to split the array. */
-  pivot = (int) randomnation((unsigned int) arraysize);
+  pivot = (int) randomnation(m, (unsigned int) arraysize);
   pivot1 = sortarray[pivot][axis];
   pivot2 = sortarray[pivot][1 - axis];
   /* Split the array. */
@@ -5559,11 +5618,11 @@ void vertexmedian(vertex *sortarray, int arraysize, int median, int axis)
   /*   conditionals is true.                             */
   if (left > median) {
     /* Recursively shuffle the left subset. */
-    vertexmedian(sortarray, left, median, axis);
+    vertexmedian(m, sortarray, left, median, axis);
   }
   if (right < median - 1) {
     /* Recursively shuffle the right subset. */
-    vertexmedian(&sortarray[right + 1], arraysize - right - 1,
+    vertexmedian(m, &sortarray[right + 1], arraysize - right - 1,
                  median - right - 1, axis);
   }
 }
@@ -5579,7 +5638,8 @@ void vertexmedian(vertex *sortarray, int arraysize, int median, int axis)
 /*                                                                           */
 /*****************************************************************************/
 
-void alternateaxes(vertex *sortarray, int arraysize, int axis)
+void alternateaxes(struct mesh *m, vertex *sortarray, int arraysize,
+                   int axis)
 {
   int divider;
 
@@ -5590,13 +5650,13 @@ void alternateaxes(vertex *sortarray, int arraysize, int axis)
     axis = 0;
   }
   /* Partition with a horizontal or vertical cut. */
-  vertexmedian(sortarray, arraysize, divider, axis);
+  vertexmedian(m, sortarray, arraysize, divider, axis);
   /* Recursively partition the subsets with a cross cut. */
   if (arraysize - divider >= 2) {
     if (divider >= 2) {
-      alternateaxes(sortarray, divider, 1 - axis);
+      alternateaxes(m, sortarray, divider, 1 - axis);
     }
-    alternateaxes(&sortarray[divider], arraysize - divider, 1 - axis);
+    alternateaxes(m, &sortarray[divider], arraysize - divider, 1 - axis);
   }
 }
 
@@ -6168,14 +6228,20 @@ long divconqdelaunay(struct mesh *m, struct behavior *b)
     printf("  Sorting vertices.\n");
   }
 
-  /* Allocate an array of pointers to vertices for sorting. */
-  sortarray = (vertex *) trimalloc(m->invertices * (int) sizeof(vertex));
+  /* Allocate an array of pointers to vertices for sorting, or reuse the */
+  /*   one of the last triangulation if it is large enough.              */
+  if (m->sortarraysize < m->invertices) {
+    trifree((int *) m->sortarray);
+    m->sortarray = (vertex *) trimalloc(m->invertices * (int) sizeof(vertex));
+    m->sortarraysize = m->invertices;
+  }
+  sortarray = m->sortarray;
   traversalinit(&m->vertices);
   for (i = 0; i < m->invertices; i++) {
     sortarray[i] = vertextraverse(m);
   }
   /* Sort the vertices. */
-  vertexsort(sortarray, m->invertices);
+  vertexsort(m, sortarray, m->invertices);
   /* Discard duplicate vertices, which can really mess up the algorithm. */
   i = 0;
   for (j = 1; j < m->invertices; j++) {
@@ -6199,9 +6265,9 @@ long divconqdelaunay(struct mesh *m, struct behavior *b)
     divider = i >> 1;
     if (i - divider >= 2) {
       if (divider >= 2) {
-        alternateaxes(sortarray, divider, 1);
+        alternateaxes(m, sortarray, divider, 1);
       }
-      alternateaxes(&sortarray[divider], i - divider, 1);
+      alternateaxes(m, &sortarray[divider], i - divider, 1);
     }
   }
 
@@ -6211,7 +6277,6 @@ long divconqdelaunay(struct mesh *m, struct behavior *b)
 
   /* Form the Delaunay triangulation. */
   divconqrecurse(m, b, sortarray, i, 0, &hullleft, &hullright);
-  trifree((int *) sortarray);
 
   return removeghosts(m, b, &hullleft);
 }
@@ -8471,6 +8536,40 @@ void statistics(struct mesh *m, struct behavior *b)
   }
 }
 
+/*****************************************************************************/
+/*                                                                           */
+/*  triangulateenginenew()    Create a triangulation engine.                 */
+/*  triangulateenginefree()   Free an engine and all memory held by it.      */
+/*                                                                           */
+/*  An engine owns a mesh, whose memory pools are kept between calls to      */
+/*  triangulate() and recycled by the next triangulation.  The results of    */
+/*  triangulate() do not depend on the engine.  Different engines may be     */
+/*  used by different threads at the same time.                              */
+/*                                                                           */
+/*****************************************************************************/
+
+struct triangulateengine {
+  struct mesh m;
+};
+
+struct triangulateengine *triangulateenginenew()
+{
+  struct triangulateengine *engine;
+
+  engine = (struct triangulateengine *)
+           trimalloc((int) sizeof(struct triangulateengine));
+  triangleinit(&engine->m);
+  return engine;
+}
+
+void triangulateenginefree(struct triangulateengine *engine)
+{
+  if (engine != (struct triangulateengine *) NULL) {
+    triangledeinit(&engine->m);
+    trifree((int *) engine);
+  }
+}
+
 /*****************************************************************************/
 /*                                                                           */
 /*  main() or triangulate()   Gosh, do everything.                           */
@@ -8497,94 +8596,96 @@ void statistics(struct mesh *m, struct behavior *b)
 /*****************************************************************************/
 
 void triangulate(char *triswitches, struct triangulateio *in,
-                 struct triangulateio *out, struct triangulateio *vorout)
+                 struct triangulateio *out, struct triangulateio *vorout,
+                 struct triangulateengine *engine)
 {
-  struct mesh m;
+  struct mesh *m;
   struct behavior b;
   float *holearray;                                        /* Array of holes. */
   float *regionarray;   /* Array of regional attributes and area constraints. */
-  
-  triangleinit(&m);
+
+  m = &engine->m;
+  trianglerestart(m);
   parsecommandline(1, &triswitches, &b);
-  m.steinerleft = b.steiner;
+  m->steinerleft = b.steiner;
 
-  transfernodes(&m, &b, in->pointlist, in->pointattributelist,
+  transfernodes(m, &b, in->pointlist, in->pointattributelist,
                 in->pointmarkerlist, in->numberofpoints,
                 in->numberofpointattributes);
 
-  m.hullsize = delaunay(&m, &b);                /* Triangulate the vertices. */
+  m->hullsize = delaunay(m, &b);                /* Triangulate the vertices. */
   /* Ensure that no vertex can be mistaken for a triangular bounding */
   /*   box vertex in insertvertex().                                 */
-  m.infvertex1 = (vertex) NULL;
-  m.infvertex2 = (vertex) NULL;
-  m.infvertex3 = (vertex) NULL;
+  m->infvertex1 = (vertex) NULL;
+  m->infvertex2 = (vertex) NULL;
+  m->infvertex3 = (vertex) NULL;
 
   if (b.usesegments) {
-    m.checksegments = 1;                /* Segments will be introduced next. */
+    m->checksegments = 1;                /* Segments will be introduced next. */
     if (!b.refine) {
       /* Insert PSLG segments and/or convex hull segments. */
-      formskeleton(&m, &b, in->segmentlist,
+      formskeleton(m, &b, in->segmentlist,
                    in->segmentmarkerlist, in->numberofsegments);
     }
   }
 
-  if (b.poly && (m.triangles.items > 0)) {
+  if (b.poly && (m->triangles.items > 0)) {
     holearray = in->holelist;
-    m.holes = in->numberofholes;
+    m->holes = in->numberofholes;
     regionarray = in->regionlist;
-    m.regions = in->numberofregions;
+    m->regions = in->numberofregions;
     if (!b.refine) {
       /* Carve out holes and concavities. */
-      carveholes(&m, &b, holearray, m.holes, regionarray, m.regions);
+      carveholes(m, &b, holearray, m->holes, regionarray, m->regions);
     }
   } else {
     /* Without a PSLG, there can be no holes or regional attributes   */
     /*   or area constraints.  The following are set to zero to avoid */
     /*   an accidental free() later.                                  */
-    m.holes = 0;
-    m.regions = 0;
+    m->holes = 0;
+    m->regions = 0;
   }
 
   /* Calculate the number of edges. */
-  m.edges = (3l * m.triangles.items + m.hullsize) / 2l;
+  m->edges = (3l * m->triangles.items + m->hullsize) / 2l;
 
   if (b.order > 1) {
-    highorder(&m, &b);       /* Promote elements to higher polynomial order. */
+    highorder(m, &b);       /* Promote elements to higher polynomial order. */
   }
   if (!b.quiet) {
     printf("\n");
   }
 
   if (b.jettison) {
-    out->numberofpoints = m.vertices.items - m.undeads;
+    out->numberofpoints = m->vertices.items - m->undeads;
   } else {
-    out->numberofpoints = m.vertices.items;
+    out->numberofpoints = m->vertices.items;
   }
-  out->numberofpointattributes = m.nextras;
-  out->numberoftriangles = m.triangles.items;
+  out->numberofpointattributes = m->nextras;
+  out->numberoftriangles = m->triangles.items;
   out->numberofcorners = (b.order + 1) * (b.order + 2) / 2;
-  out->numberoftriangleattributes = m.eextras;
-  out->numberofedges = m.edges;
+  out->numberoftriangleattributes = m->eextras;
+  out->numberofedges = m->edges;
   if (b.usesegments) {
-    out->numberofsegments = m.subsegs.items;
+    out->numberofsegments = m->subsegs.items;
   } else {
-    out->numberofsegments = m.hullsize;
+    out->numberofsegments = m->hullsize;
   }
   if (vorout != (struct triangulateio *) NULL) {
-    vorout->numberofpoints = m.triangles.items;
-    vorout->numberofpointattributes = m.nextras;
-    vorout->numberofedges = m.edges;
+    vorout->numberofpoints = m->triangles.items;
+    vorout->numberofpointattributes = m->nextras;
+    vorout->numberofedges = m->edges;
   }
   /* If not using iteration numbers, don't write a .node file if one was */
   /*   read, because the original one would be overwritten!              */
-  if (b.nonodewritten || (b.noiterationnum && m.readnodefile)) {
+  if (b.nonodewritten || (b.noiterationnum && m->readnodefile)) {
     if (!b.quiet) {
       printf("NOT writing vertices.\n");
     }
-    numbernodes(&m, &b);         /* We must remember to number the vertices. */
+    numbernodes(m, &b);         /* We must remember to number the vertices. */
   } else {
     /* writenodes() numbers the vertices too. */
-    writenodes(&m, &b, &out->pointlist, &out->pointattributelist,
+    writenodes(m, &b, &out->pointlist, &out->pointattributelist,
                &out->pointmarkerlist);
   }
   if (b.noelewritten) {
@@ -8592,7 +8693,7 @@ void triangulate(char *triswitches, struct triangulateio *in,
       printf("NOT writing triangles.\n");
     }
   } else {
-    writeelements(&m, &b, &out->trianglelist, &out->triangleattributelist);
+    writeelements(m, &b, &out->trianglelist, &out->triangleattributelist);
   }
   /* The -c switch (convex switch) causes a PSLG to be written */
   /*   even if none was read.                                  */
@@ -8603,9 +8704,9 @@ void triangulate(char *triswitches, struct triangulateio *in,
         printf("NOT writing segments.\n");
       }
     } else {
-      writepoly(&m, &b, &out->segmentlist, &out->segmentmarkerlist);
-      out->numberofholes = m.holes;
-      out->numberofregions = m.regions;
+      writepoly(m, &b, &out->segmentlist, &out->segmentmarkerlist);
+      out->numberofholes = m->holes;
+      out->numberofregions = m->regions;
       if (b.poly) {
         out->holelist = in->holelist;
         out->regionlist = in->regionlist;
@@ -8616,20 +8717,29 @@ void triangulate(char *triswitches, struct triangulateio *in,
     }
   }
   if (b.edgesout) {
-    writeedges(&m, &b, &out->edgelist, &out->edgemarkerlist);
+    writeedges(m, &b, &out->edgelist, &out->edgemarkerlist);
   }
   if (b.voronoi) {
-    writevoronoi(&m, &b, &vorout->pointlist, &vorout->pointattributelist,
+    writevoronoi(m, &b, &vorout->pointlist, &vorout->pointattributelist,
                  &vorout->pointmarkerlist, &vorout->edgelist,
                  &vorout->edgemarkerlist, &vorout->normlist);
   }
   if (b.neighbors) {
-    writeneighbors(&m, &b, &out->neighborlist);
+    writeneighbors(m, &b, &out->neighborlist);
   }
 
   if (!b.quiet) {
-    statistics(&m, &b);
+    statistics(m, &b);
   }
 
-  triangledeinit(&m, &b);
+}
+
+void triangulate(char *triswitches, struct triangulateio *in,
+                 struct triangulateio *out, struct triangulateio *vorout)
+{
+  struct triangulateengine engine;
+
+  triangleinit(&engine.m);
+  triangulate(triswitches, in, out, vorout, &engine);
+  triangledeinit(&engine.m);
 }
@@ -77,6 +77,12 @@
 /*  and the Voronoi output.  If the `v' (Voronoi output) switch is not used, */
 /*  `vorout' may be NULL.  `in' and `out' may never be NULL.                 */
 /*                                                                           */
+/*  A fifth argument `engine' (see triangulateenginenew()) makes the call    */
+/*  reentrant and lets Triangle recycle the memory pools of the previous     */
+/*  call on the same engine instead of allocating them again.  An engine     */
+/*  must not be used by two threads at the same time; distinct engines, and  */
+/*  the four argument version, may be used concurrently.                     */
+/*                                                                           */
 /*  Certain fields of the input and output structures must be initialized,   */
 /*  as described below.                                                      */
 /*                                                                           */
@@ -280,6 +286,12 @@ struct triangulateio {
   int numberofedges;                                             /* Out only */
 };
 
+struct triangulateengine;
+
+struct triangulateengine *triangulateenginenew();
+void triangulateenginefree(struct triangulateengine *engine);
 void triangulate(char *,triangulateio *,triangulateio *,triangulateio *);
+void triangulate(char *,triangulateio *,triangulateio *,triangulateio *,
+                 triangulateengine *engine);
 void trifree(int *memptr);
 
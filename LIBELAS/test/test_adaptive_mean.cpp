@@ -0,0 +1,160 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+// Test: the SSE adaptive mean filter against a scalar port of the original
+// filter (ring buffer of taps, summed in ring order). process() is run with
+// and without filter_adaptive_mean, the scalar filter is applied to the
+// unfiltered map and both results must agree within a relative tolerance
+// (the SSE filter sums the weights in another order).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "elas.h"
+#include "image.h"
+
+#ifndef LIBELAS_IMG_DIR
+#define LIBELAS_IMG_DIR "img"
+#endif
+
+static const float tolerance = 1e-6f;
+
+// the original filter masks val-center with the float 2^31, whose bit
+// pattern is 0x4F000000 (see Elas::adaptiveMeanSums)
+static float absMask (float x) {
+  uint32_t bits;
+  memcpy(&bits,&x,sizeof(bits));
+  bits &= 0x4F000000;
+  memcpy(&x,&bits,sizeof(bits));
+  return x;
+}
+
+static float weight (float val,float center) {
+  float w = 4-absMask(val-center);
+  return w>0 ? w : 0;
+}
+
+// filters one row (stride 1) or column (stride width) of n values from
+// D_in to D_out, the window of c is [c-taps/2,c+taps/2-1]
+static void filterLine (const float* D_in,float* D_out,int32_t n,int32_t stride,int32_t taps) {
+  float val[8];
+  for (int32_t i=0; i<taps-1; i++)
+    val[i] = D_in[i*stride];
+  for (int32_t i=taps-1; i<n; i++) {
+    int32_t c      = i-taps/2+1;
+    float   center = D_in[c*stride];
+    val[i%taps]    = D_in[i*stride];
+    float weight_lane[4],factor_lane[4];
+    for (int32_t k=0; k<4; k++) {
+      weight_lane[k] = weight(val[k],center);
+      factor_lane[k] = val[k]*weight_lane[k];
+      if (taps==8) {
+        float w2 = weight(val[k+4],center);
+        weight_lane[k] += w2;
+        factor_lane[k] += val[k+4]*w2;
+      }
+    }
+    float weight_sum = weight_lane[0]+weight_lane[1]+weight_lane[2]+weight_lane[3];
+    float factor_sum = factor_lane[0]+factor_lane[1]+factor_lane[2]+factor_lane[3];
+    if (weight_sum>0) {
+      float d = factor_sum/weight_sum;
+      if (d>=0) D_out[c*stride] = d;
+    }
+  }
+}
+
+static void adaptiveMeanScalar (float* D,int32_t width,int32_t height,int32_t taps) {
+
+  // invalid disparities are set to -10 for both filters
+  float* D_copy = (float*)malloc(width*height*sizeof(float));
+  float* D_tmp  = (float*)malloc(width*height*sizeof(float));
+  for (int32_t i=0; i<width*height; i++)
+    D_copy[i] = D_tmp[i] = D[i]<0 ? -10 : D[i];
+
+  for (int32_t v=3; v<height-3; v++)
+    filterLine(D_copy+v*width,D_tmp+v*width,width,1,taps);
+  for (int32_t u=3; u<width-3; u++)
+    filterLine(D_tmp+u,D+u,height,width,taps);
+
+  free(D_copy);
+  free(D_tmp);
+}
+
+int main (int argc,char** argv) {
+
+  const char* pair = argc>1 ? argv[1] : "aloe";
+  char file_1[1024],file_2[1024];
+  snprintf(file_1,sizeof(file_1),"%s/%s_left.pgm",LIBELAS_IMG_DIR,pair);
+  snprintf(file_2,sizeof(file_2),"%s/%s_right.pgm",LIBELAS_IMG_DIR,pair);
+  ELAS::image<ELAS::uchar> *I1 = ELAS::loadPGM(file_1);
+  ELAS::image<ELAS::uchar> *I2 = ELAS::loadPGM(file_2);
+
+  int32_t dims[3] = {I1->width(),I1->height(),I1->width()};
+  int32_t size    = dims[0]*dims[1];
+  float*  D1      = (float*)malloc(size*sizeof(float));
+  float*  D2      = (float*)malloc(size*sizeof(float));
+  float*  D_ref   = (float*)malloc(size*sizeof(float));
+
+  int32_t num_failed = 0;
+  for (int32_t subsampling=0; subsampling<2; subsampling++) {
+    for (int32_t num_threads=1; num_threads<=2; num_threads++) {
+
+      // the filter is the last step of ROBOTICS, which postprocesses D1 only
+      Elas::parameters param(Elas::ROBOTICS);
+      param.subsampling = subsampling!=0;
+      param.num_threads = num_threads;
+      int32_t width     = subsampling ? dims[0]/2 : dims[0];
+      int32_t height    = subsampling ? dims[1]/2 : dims[1];
+
+      param.filter_adaptive_mean = 0;
+      Elas(param).process(I1->data,I2->data,D_ref,D2,dims);
+      adaptiveMeanScalar(D_ref,width,height,subsampling ? 4 : 8);
+      param.filter_adaptive_mean = 1;
+      Elas(param).process(I1->data,I2->data,D1,D2,dims);
+
+      int32_t num_invalid = 0,num_diff = 0;
+      double  max_diff    = 0;
+      for (int32_t i=0; i<width*height; i++) {
+        if ((D1[i]>=0)!=(D_ref[i]>=0)) {
+          num_invalid++;
+        } else if (D_ref[i]>=0) {
+          double diff = fabs(D1[i]-D_ref[i])/fmax(D_ref[i],1);
+          max_diff = fmax(max_diff,diff);
+          if (diff>tolerance)
+            num_diff++;
+        }
+      }
+
+      printf("subsampling=%d threads=%d: max relative difference %g, %d pixels above %g, %d validity changes\n",
+             subsampling,num_threads,max_diff,num_diff,tolerance,num_invalid);
+      if (num_diff>0 || num_invalid>0)
+        num_failed++;
+    }
+  }
+
+  free(D1);
+  free(D2);
+  free(D_ref);
+  delete I1;
+  delete I2;
+  return num_failed>0 ? 1 : 0;
+}
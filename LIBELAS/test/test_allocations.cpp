@@ -0,0 +1,180 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+// Test: after the first call to process() all memory is allocated, the
+// following calls on images of the same size must not touch the heap. The
+// heap functions of the C library are replaced by counting wrappers (this
+// needs glibc, the test is skipped elsewhere). operator new ends up in
+// malloc, hence it is counted as well. Not counted is the bookkeeping of the
+// OpenMP runtime itself: libgomp allocates and frees the team of each
+// parallel region that runs on a single thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include "elas.h"
+#include "image.h"
+
+#ifndef LIBELAS_IMG_DIR
+#define LIBELAS_IMG_DIR "img"
+#endif
+
+#ifdef __GLIBC__
+
+extern "C" void* __libc_malloc (size_t n);
+extern "C" void* __libc_calloc (size_t n,size_t size);
+extern "C" void* __libc_realloc (void* p,size_t n);
+extern "C" void* __libc_memalign (size_t alignment,size_t n);
+
+static long num_allocations = 0;
+
+// true if the caller of the heap function is the OpenMP runtime
+static bool isRuntime (void* caller) {
+  Dl_info info;
+  return dladdr(caller,&info) && info.dli_fname && strstr(info.dli_fname,"libgomp");
+}
+
+static void count (void* caller) {
+  if (!isRuntime(caller))
+    __atomic_add_fetch(&num_allocations,1,__ATOMIC_RELAXED);
+}
+
+extern "C" void* malloc (size_t n) {
+  count(__builtin_return_address(0));
+  return __libc_malloc(n);
+}
+
+extern "C" void* calloc (size_t n,size_t size) {
+  count(__builtin_return_address(0));
+  return __libc_calloc(n,size);
+}
+
+extern "C" void* realloc (void* p,size_t n) {
+  count(__builtin_return_address(0));
+  return __libc_realloc(p,n);
+}
+
+extern "C" void* memalign (size_t alignment,size_t n) {
+  count(__builtin_return_address(0));
+  return __libc_memalign(alignment,n);
+}
+
+extern "C" void* aligned_alloc (size_t alignment,size_t n) {
+  count(__builtin_return_address(0));
+  return __libc_memalign(alignment,n);
+}
+
+extern "C" int posix_memalign (void** p,size_t alignment,size_t n) {
+  count(__builtin_return_address(0));
+  *p = __libc_memalign(alignment,n);
+  return *p ? 0 : 12; // ENOMEM
+}
+
+static long getAllocations () {
+  return __atomic_load_n(&num_allocations,__ATOMIC_RELAXED);
+}
+
+// configurations: setting, subsampling, fast triangulation, threads,
+// temporal support (then the previous maps are passed too)
+struct config {
+  Elas::setting setting;
+  int32_t subsampling,fast_triangulation,num_threads,temporal;
+};
+
+static const config configs[] = {
+  {Elas::ROBOTICS,  0,0,1,0},
+  {Elas::ROBOTICS,  0,0,2,0},
+  {Elas::ROBOTICS,  0,1,1,0},
+  {Elas::ROBOTICS,  0,1,2,0},
+  {Elas::ROBOTICS,  1,0,2,0},
+  {Elas::ROBOTICS,  0,0,2,1},
+  {Elas::MIDDLEBURY,0,0,1,0},
+  {Elas::MIDDLEBURY,0,0,2,0},
+  {Elas::MIDDLEBURY,1,1,2,0},
+};
+static const int32_t num_configs = sizeof(configs)/sizeof(configs[0]);
+
+// number of calls after the first one, which allocates the workspace (in
+// video mode after the second one, which sets up the previous maps as well)
+static const int32_t num_frames = 3;
+
+int main (int argc,char** argv) {
+
+  const char* pair = argc>1 ? argv[1] : "aloe";
+  char file_1[1024],file_2[1024];
+  snprintf(file_1,sizeof(file_1),"%s/%s_left.pgm",LIBELAS_IMG_DIR,pair);
+  snprintf(file_2,sizeof(file_2),"%s/%s_right.pgm",LIBELAS_IMG_DIR,pair);
+  ELAS::image<ELAS::uchar> *I1 = ELAS::loadPGM(file_1);
+  ELAS::image<ELAS::uchar> *I2 = ELAS::loadPGM(file_2);
+  if (I1->width()!=I2->width() || I1->height()!=I2->height()) {
+    printf("images %s and %s differ in size\n",file_1,file_2);
+    return 1;
+  }
+
+  int32_t width   = I1->width();
+  int32_t height  = I1->height();
+  int32_t dims[3] = {width,height,width};
+  float*  D1      = (float*)malloc(width*height*sizeof(float));
+  float*  D2      = (float*)malloc(width*height*sizeof(float));
+
+  int32_t num_failed = 0;
+  for (int32_t i=0; i<num_configs; i++) {
+    const config &c = configs[i];
+    Elas::parameters param(c.setting);
+    param.subsampling        = c.subsampling!=0;
+    param.fast_triangulation = c.fast_triangulation!=0;
+    param.num_threads        = c.num_threads;
+    param.temporal_support   = c.temporal!=0;
+
+    Elas elas(param);
+    const float* D1_prev = c.temporal ? D1 : 0;
+    const float* D2_prev = c.temporal ? D2 : 0;
+    elas.process(I1->data,I2->data,D1,D2,dims);
+    if (c.temporal)
+      elas.process(I1->data,I2->data,D1,D2,dims,D1_prev,D2_prev);
+    long num = getAllocations();
+    for (int32_t frame=0; frame<num_frames; frame++)
+      elas.process(I1->data,I2->data,D1,D2,dims,D1_prev,D2_prev);
+    num = getAllocations()-num;
+
+    printf("%s subsampling=%d fast_triangulation=%d threads=%d temporal=%d: "
+           "%ld allocations in %d frames\n",c.setting==Elas::ROBOTICS ? "ROBOTICS" : "MIDDLEBURY",
+           c.subsampling,c.fast_triangulation,c.num_threads,c.temporal,num,num_frames);
+    if (num!=0)
+      num_failed++;
+  }
+
+  free(D1);
+  free(D2);
+  delete I1;
+  delete I2;
+  return num_failed>0 ? 1 : 0;
+}
+
+#else
+
+int main () {
+  printf("the allocation counter needs glibc, skipped\n");
+  return 77; // SKIP_RETURN_CODE
+}
+
+#endif
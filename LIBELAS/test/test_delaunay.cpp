@@ -0,0 +1,146 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+// Test: Delaunay::update() on a sequence of point sets which change a few
+// points per frame, like the support points of a video. the points lie on a
+// regular grid (many cocircular points) plus the image corners, in the left
+// image (grid columns) and shifted by a disparity (right image). each result
+// must be a Delaunay triangulation of the points: counterclockwise triangles
+// with no point strictly inside their circumcircle, the same number of
+// triangles and the same area as the triangulation from scratch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "delaunay.h"
+
+using namespace std;
+
+static const int32_t width  = 200;
+static const int32_t height = 150;
+static const int32_t step   = 5;
+static const int32_t num_frames = 40;
+
+// linear congruential generator, the test must not depend on rand()
+static uint32_t lcg_state = 1;
+static uint32_t random32 () {
+  lcg_state = lcg_state*1664525u+1013904223u;
+  return lcg_state>>8;
+}
+
+static int64_t ccw (const int32_t* a,const int32_t* b,const int32_t* c) {
+  return (int64_t)(b[0]-a[0])*(c[1]-a[1])-(int64_t)(b[1]-a[1])*(c[0]-a[0]);
+}
+
+static bool inCircle (const int32_t* a,const int32_t* b,const int32_t* c,const int32_t* d) {
+  int64_t adx = a[0]-d[0], ady = a[1]-d[1];
+  int64_t bdx = b[0]-d[0], bdy = b[1]-d[1];
+  int64_t cdx = c[0]-d[0], cdy = c[1]-d[1];
+  return (adx*adx+ady*ady)*(bdx*cdy-cdx*bdy)+(bdx*bdx+bdy*bdy)*(cdx*ady-adx*cdy)+
+         (cdx*cdx+cdy*cdy)*(adx*bdy-bdx*ady) > 0;
+}
+
+// returns the number of errors of triangulation tri of the points
+static int32_t checkDelaunay (const vector<int32_t> &points,const vector<int32_t> &tri,int64_t &area2) {
+  int32_t n = points.size()/2;
+  int32_t num_errors = 0;
+  area2 = 0;
+  for (size_t k=0; k<tri.size(); k+=3) {
+    const int32_t* a = &points[2*tri[k]];
+    const int32_t* b = &points[2*tri[k+1]];
+    const int32_t* c = &points[2*tri[k+2]];
+    int64_t o = ccw(a,b,c);
+    area2 += o;
+    if (o<=0)
+      num_errors++;
+    for (int32_t i=0; i<n; i++)
+      if (inCircle(a,b,c,&points[2*i]))
+        num_errors++;
+  }
+  return num_errors;
+}
+
+int main () {
+
+  // grid positions, a point is present if its flag is set
+  vector<int32_t> grid_u,grid_v,grid_d;
+  for (int32_t v=step; v<height; v+=step) {
+    for (int32_t u=step; u<width; u+=step) {
+      grid_u.push_back(u);
+      grid_v.push_back(v);
+      grid_d.push_back(random32()%4);
+    }
+  }
+  int32_t num_grid = grid_u.size();
+  vector<uint8_t> present(num_grid);
+  for (int32_t i=0; i<num_grid; i++)
+    present[i] = random32()%4!=0;
+
+  int32_t num_failed = 0;
+  for (int32_t right=0; right<2; right++) {
+    Delaunay delaunay,reference;
+    vector<int32_t> points,tri,tri_ref;
+    int32_t num_incremental = 0;
+    for (int32_t frame=0; frame<num_frames; frame++) {
+
+      // a few points appear or disappear (and move in the right image)
+      if (frame>0) {
+        int32_t num_changes = 1+random32()%(frame%8==7 ? 200 : 12);
+        for (int32_t k=0; k<num_changes; k++) {
+          int32_t i = random32()%num_grid;
+          present[i] = !present[i];
+          grid_d[i]  = random32()%4;
+        }
+      }
+
+      // image corners first, then the grid points
+      points.clear();
+      int32_t corners[8] = {0,0,0,height-1,width-1,0,width-1,height-1};
+      points.insert(points.end(),corners,corners+8);
+      for (int32_t i=0; i<num_grid; i++) {
+        if (present[i]) {
+          points.push_back(right ? grid_u[i]-grid_d[i] : grid_u[i]);
+          points.push_back(grid_v[i]);
+        }
+      }
+      int32_t n = points.size()/2;
+
+      bool incremental;
+      delaunay.update(&points[0],n,tri,n/8,incremental);
+      reference.triangulate(&points[0],n,tri_ref);
+      num_incremental += incremental ? 1 : 0;
+
+      int64_t area2,area2_ref;
+      int32_t num_errors = checkDelaunay(points,tri,area2);
+      checkDelaunay(points,tri_ref,area2_ref);
+      if (num_errors>0 || tri.size()!=tri_ref.size() || area2!=area2_ref) {
+        printf("%s image, frame %d (%s): %d errors, %d/%d triangles, area %lld/%lld\n",
+               right ? "right" : "left",frame,incremental ? "updated" : "triangulated",num_errors,
+               (int)tri.size()/3,(int)tri_ref.size()/3,(long long)area2/2,(long long)area2_ref/2);
+        num_failed++;
+      }
+    }
+    printf("%s image: %d of %d frames updated incrementally\n",right ? "right" : "left",num_incremental,num_frames);
+    if (num_incremental==0)
+      num_failed++;
+  }
+  return num_failed>0 ? 1 : 0;
+}
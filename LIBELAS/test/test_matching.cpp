@@ -0,0 +1,137 @@
+/*
+Copyright 2011. All rights reserved.
+Institute of Measurement and Control Systems
+Karlsruhe Institute of Technology, Germany
+
+This file is part of libelas.
+Authors: Andreas Geiger
+
+libelas is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or any later version.
+
+libelas is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libelas; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+// Test: the SAD kernels of every instruction set this CPU supports must give
+// exactly the costs of a scalar SAD, on random descriptors and on descriptors
+// which give the largest possible costs. process() itself only runs the best
+// instruction set, hence the others are called directly (matching::detail).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+#include "matching.h"
+
+// descriptor image: width x height descriptors of 16 bytes, the support
+// matching offsets are those of Elas::computeMatchingDisparity
+static const int32_t width  = 160;
+static const int32_t height = 9;
+static const int32_t step   = 2;
+
+typedef void (*sad_block4)(const uint8_t*,const uint8_t*,const int32_t*,int32_t,int32_t*);
+typedef void (*sad_list)(const uint8_t*,const uint8_t* const*,int32_t,int32_t*);
+
+static int32_t sad (const uint8_t* a,const uint8_t* b) {
+  int32_t s = 0;
+  for (int32_t i=0; i<16; i++)
+    s += abs((int32_t)a[i]-(int32_t)b[i]);
+  return s;
+}
+
+// linear congruential generator, the test must not depend on rand()
+static uint32_t lcg_state = 1;
+static uint8_t random8 () {
+  lcg_state = lcg_state*1664525u+1013904223u;
+  return (uint8_t)(lcg_state>>24);
+}
+
+// compares the kernels of one instruction set with the scalar SAD,
+// returns the number of wrong costs
+static int32_t checkKernels (sad_block4 block4,sad_list list,const uint8_t* I1,const uint8_t* I2) {
+
+  const int32_t offset[4] = {-16*step-16*width*step,+16*step-16*width*step,
+                             -16*step+16*width*step,+16*step+16*width*step};
+  const int32_t max_n = 64;
+  int32_t cost[max_n];
+  int32_t num_wrong = 0;
+  int32_t v = height/2;
+
+  // sadBlock4: all chunk lengths (up to the one of the support matching)
+  // and start positions, which covers all tails of the wide kernels
+  for (int32_t n=0; n<=max_n; n++) {
+    for (int32_t u=step; u+n+step<=width; u+=7) {
+      const uint8_t* I1_block = I1+16*(v*width+u);
+      const uint8_t* I2_block = I2+16*(v*width+u);
+      block4(I1_block,I2_block,offset,n,cost);
+      for (int32_t k=0; k<n; k++) {
+        int32_t ref = 0;
+        for (int32_t j=0; j<4; j++)
+          ref += sad(I1_block+offset[j],I2_block+16*k+offset[j]);
+        if (cost[k]!=ref)
+          num_wrong++;
+      }
+    }
+  }
+
+  // sadList: random descriptor addresses
+  const uint8_t* I2_block[max_n];
+  for (int32_t n=0; n<=max_n; n++) {
+    for (int32_t rep=0; rep<16; rep++) {
+      const uint8_t* I1_block = I1+16*(random8()%(width*height));
+      for (int32_t k=0; k<n; k++)
+        I2_block[k] = I2+16*((random8()*256+random8())%(width*height));
+      list(I1_block,I2_block,n,cost);
+      for (int32_t k=0; k<n; k++)
+        if (cost[k]!=sad(I1_block,I2_block[k]))
+          num_wrong++;
+    }
+  }
+  return num_wrong;
+}
+
+int main () {
+
+  const char* names[3]    = {"SSE2","AVX2","AVX-512BW"};
+  sad_block4  block4[3]   = {matching::detail::sadBlock4_sse2,matching::detail::sadBlock4_avx2,
+                             matching::detail::sadBlock4_avx512};
+  sad_list    list[3]     = {matching::detail::sadList_sse2,matching::detail::sadList_avx2,
+                             matching::detail::sadList_avx512};
+  int32_t     num_sets    = (int32_t)matching::detectInstructionSet()+1;
+
+  int32_t size = 16*width*height;
+  uint8_t* I1  = (uint8_t*)_mm_malloc(size,16);
+  uint8_t* I2  = (uint8_t*)_mm_malloc(size,16);
+
+  int32_t num_failed = 0;
+  for (int32_t pass=0; pass<2; pass++) {
+
+    // random descriptors, then the largest costs (all 0 against all 255)
+    for (int32_t i=0; i<size; i++) {
+      I1[i] = pass==0 ? random8() : 0;
+      I2[i] = pass==0 ? random8() : 255;
+    }
+
+    for (int32_t s=0; s<3; s++) {
+      if (s>=num_sets) {
+        printf("%s: not supported by this CPU, skipped\n",names[s]);
+        continue;
+      }
+      int32_t num_wrong = checkKernels(block4[s],list[s],I1,I2);
+      printf("%s, %s descriptors: %d wrong costs\n",names[s],pass==0 ? "random" : "extreme",num_wrong);
+      if (num_wrong>0)
+        num_failed++;
+    }
+  }
+
+  _mm_free(I1);
+  _mm_free(I2);
+  return num_failed>0 ? 1 : 0;
+}